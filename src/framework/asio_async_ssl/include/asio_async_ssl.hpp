@@ -20,5 +20,11 @@ using socket_t = ssl::stream<tcp::socket>;
 using results_t = tcp::resolver::results_type;
 using error_code_t = boost::system::error_code;
 using strand_t = net::strand<net::io_context::executor_type>;
+using buffers_t = std::array<net::const_buffer, 2>;
+
+inline buffers_t buffers(const frame& frame)
+{
+    return { net::buffer(frame.header()), net::buffer(frame.payload().data(), frame.payload().size()) };
+}
 
 #endif
@@ -44,8 +44,7 @@ class request : public std::enable_shared_from_this<request<T>>
     
         void do_read_header()
         {
-            buffer_.resize(header_size());
-            net::async_read(socket_, net::buffer(buffer_), net::bind_executor(strand_,
+            net::async_read(socket_, net::buffer(frame_.header()), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
                 self->on_read_header(ec, bytes_transferred);
@@ -62,8 +61,8 @@ class request : public std::enable_shared_from_this<request<T>>
 
         void do_read_message()
         {
-            size_t size = carrier_.decode_header(buffer_);
-            net::async_read(socket_, net::buffer(std::addressof(buffer_[header_size()]), size), net::bind_executor(strand_,
+            size_t size = carrier_.decode_header(frame_);
+            net::async_read(socket_, net::buffer(frame_.payload().data(), size), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
                 self->on_read_message(ec, bytes_transferred);
@@ -80,12 +79,11 @@ class request : public std::enable_shared_from_this<request<T>>
 
         void do_write()
         {
-            auto opt = gw.parse(carrier_, buffer_, shared_this());
+            auto opt = gw.parse(carrier_, frame_, shared_this());
             if (! opt)
                 return;
 
-            carrier_.pack(buffer_);
-            net::async_write(opt.value()->get(), net::buffer(buffer_), net::bind_executor(strand_,
+            net::async_write(opt.value()->get(), buffers(frame_), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
                 self->on_write(ec, bytes_transferred);
@@ -104,7 +102,7 @@ class request : public std::enable_shared_from_this<request<T>>
         T& gw;
         socket_t socket_;
         strand_t strand_;
-        buffer_t buffer_;
+        frame frame_;
         carrier_t carrier_;
 };
    
@@ -168,8 +166,7 @@ class response : public std::enable_shared_from_this<response<T>>
 
         void do_read_header()
         {
-            buffer_.resize(header_size());
-            net::async_read(socket_, net::buffer(buffer_), net::bind_executor(strand_,
+            net::async_read(socket_, net::buffer(frame_.header()), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
                 self->on_read_header(ec, bytes_transferred);
@@ -189,8 +186,8 @@ class response : public std::enable_shared_from_this<response<T>>
 
         void do_read_message()
         {
-            size_t size = carrier_.decode_header(buffer_);
-            net::async_read(socket_, net::buffer(std::addressof(buffer_[header_size()]), size), net::bind_executor(strand_,
+            size_t size = carrier_.decode_header(frame_);
+            net::async_read(socket_, net::buffer(frame_.payload().data(), size), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
                 self->on_read_message(ec, bytes_transferred);
@@ -210,12 +207,11 @@ class response : public std::enable_shared_from_this<response<T>>
 
         void do_write()
         {
-            auto opt = gw.parse(carrier_, buffer_);
+            auto opt = gw.parse(carrier_, frame_);
             if (! opt)
                 return;
 
-            carrier_.pack(buffer_);
-            net::async_write(opt.value()->get(), net::buffer(buffer_), net::bind_executor(strand_,
+            net::async_write(opt.value()->get(), buffers(frame_), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
                 self->on_write(ec, bytes_transferred);
@@ -235,7 +231,7 @@ class response : public std::enable_shared_from_this<response<T>>
         tcp::resolver resolver_;
         socket_t socket_;
         strand_t strand_;
-        buffer_t buffer_;
+        frame frame_;
         carrier_t carrier_;
         std::string host_;
         uint32_t service_;
@@ -246,6 +242,7 @@ class listener : public std::enable_shared_from_this<listener>
     public:
         using request_t = std::shared_ptr<request<listener>>;
         using response_t = std::shared_ptr<response<listener>>;
+        using plugin_t = std::function<bool(carrier_t&)>;
     
         listener(net::io_context& ioc_, endpoint_t endpoint) :
         ioc(ioc_), acceptor_(ioc), ctx_server_(ssl::context::sslv23), ctx_client_(ssl::context::sslv23_client)
@@ -294,29 +291,44 @@ class listener : public std::enable_shared_from_this<listener>
             responses.erase(service);
         }
 
-        std::optional<request_t> parse(carrier_t& carrier_, const buffer_t& buffer_)
+        void route(uint32_t service, plugin_t plugin)
         {
-            auto header = carrier_.header();
-            carrier_.decode_message(buffer_);
-            auto it = requests.find(header->seq());
+            plugins.insert_or_assign(service, std::move(plugin));
+        }
+
+        std::optional<request_t> parse(carrier_t& carrier_, frame& frame_)
+        {
+            auto& header = carrier_.header();
+            auto it = requests.find(header.seq());
             if (it == requests.end())
                 return {};
             auto ptr = it->second.second;
-            header->set_seq(it->second.first);
+            protocol::patch_seq(frame_.header().data(), it->second.first);
             requests.erase(it);
             return ptr;
         }
     
-        std::optional<response_t> parse(carrier_t& carrier_, const buffer_t& buffer_, request_t ptr)
+        std::optional<response_t> parse(carrier_t& carrier_, frame& frame_, request_t ptr)
         {
-            auto header = carrier_.header();
-            carrier_.decode_message(buffer_);
-            auto it = responses.find(header->service());
+            auto& header = carrier_.header();
+            auto plugin = plugins.find(header.service());
+            if (plugin != plugins.end())
+            {
+                if (! carrier_.decode_message(frame_) || ! plugin->second(carrier_))
+                    return {};
+            }
+            auto it = responses.find(header.service());
             if (it == responses.end())
                 return {};
             uint32_t seq = next();
-            requests.try_emplace(seq, header->seq(), ptr);
-            header->set_seq(seq);
+            requests.try_emplace(seq, header.seq(), ptr);
+            if (plugin == plugins.end())
+                protocol::patch_seq(frame_.header().data(), seq);
+            else
+            {
+                header.set_seq(seq);
+                carrier_.pack(frame_);
+            }
             return it->second;
         }
 
@@ -357,6 +369,7 @@ class listener : public std::enable_shared_from_this<listener>
         tcp::acceptor acceptor_;
         ssl::context ctx_server_;
         ssl::context ctx_client_;
+        hashmap_t<plugin_t> plugins;
         hashmap_t<response_t> responses;
         hashmap_t<std::pair<uint32_t, request_t>> requests;
 };
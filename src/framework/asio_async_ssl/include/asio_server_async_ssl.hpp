@@ -2,6 +2,7 @@
 #define ASIO_SERVER_ASYNC_SSL_HPP
 
 #include <asio_async_ssl.hpp>
+#include <runtime.hpp>
 #include <server_certificate.hpp>
  
 class session : public std::enable_shared_from_this<session>
@@ -36,8 +37,7 @@ class session : public std::enable_shared_from_this<session>
     
         void do_read_header()
         {
-            buffer_.resize(header_size());
-            net::async_read(socket_, net::buffer(buffer_), net::bind_executor(strand_,
+            net::async_read(socket_, net::buffer(frame_.header()), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
                 self->on_read_header(ec, bytes_transferred);
@@ -54,8 +54,8 @@ class session : public std::enable_shared_from_this<session>
 
         void do_read_message()
         {
-            size_t size = carrier_.decode_header(buffer_);
-            net::async_read(socket_, net::buffer(std::addressof(buffer_[header_size()]), size), net::bind_executor(strand_,
+            size_t size = carrier_.decode_header(frame_);
+            net::async_read(socket_, net::buffer(frame_.payload().data(), size), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
                 self->on_read_message(ec, bytes_transferred);
@@ -72,7 +72,7 @@ class session : public std::enable_shared_from_this<session>
 
         void do_write()
         {
-            net::async_write(socket_, net::buffer(buffer_), net::bind_executor(strand_,
+            net::async_write(socket_, buffers(frame_), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
                 self->on_write(ec, bytes_transferred);
@@ -84,20 +84,21 @@ class session : public std::enable_shared_from_this<session>
             if (ec)
                 return fail(ec, "write");
 
+            frame_.payload().release();
             do_read_header();
         }
 
     private:
         socket_t socket_;
         strand_t strand_;
-        buffer_t buffer_;
+        frame frame_;
         carrier_t carrier_;
 };
 
 class listener : public std::enable_shared_from_this<listener>
 {
     public:
-        listener(net::io_context& ioc, endpoint_t endpoint) :
+        listener(net::io_context& ioc, endpoint_t endpoint, bool reuseport = false) :
         acceptor_(ioc), ctx_server_(ssl::context::sslv23)
         {
             load_server_certificate(ctx_server_);
@@ -118,6 +119,14 @@ class listener : public std::enable_shared_from_this<listener>
                 return;
             }
 
+            if (reuseport)
+                acceptor_.set_option(reuse_port(true), ec);
+            if (ec)
+            {
+                fail(ec, "set_option");
+                return;
+            }
+
             acceptor_.bind(endpoint, ec);
             if (ec)
             {
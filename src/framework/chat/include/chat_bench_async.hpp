@@ -0,0 +1,189 @@
+#ifndef CHAT_BENCH_ASYNC_HPP
+#define CHAT_BENCH_ASYNC_HPP
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <net.hpp>
+#include <outbox.hpp>
+#include <heartbeat.hpp>
+
+// latencies are only touched on the bench's io_context thread
+struct stats
+{
+    std::atomic<size_t> connected = 0;
+    std::atomic<size_t> sent = 0;
+    std::atomic<size_t> received = 0;
+    std::vector<uint32_t> latencies;
+};
+
+inline int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// chatty client that moves from room 0 to its own room and sends a line every
+// interval carrying the time it was sent; every line it gets back, its own
+// included, is one delivery whose latency is recorded
+class session : public std::enable_shared_from_this<session>
+{
+    public:
+        session(net::io_context& ioc, stats& stats, uint16_t room, std::chrono::microseconds interval, std::chrono::microseconds offset) :
+        socket_(ioc), timer_(ioc), stats_(stats), room_(room), interval_(interval), offset_(offset)
+        {
+        }
+
+        std::shared_ptr<session> shared_this()
+        {
+            return shared_from_this();
+        }
+
+        void run(const results_t& results)
+        {
+            net::async_connect(socket_, results,
+            [self = shared_this()](error_code_t ec, const endpoint_t&)
+            {
+                self->on_connect(ec);
+            });
+        }
+
+        void on_connect(error_code_t ec)
+        {
+            if (ec)
+                return fail(ec, "connect");
+
+            ++stats_.connected;
+            send(mode_type::subscribe, room_, "");
+            send(mode_type::unsubscribe, 0, "");
+            do_read();
+
+            timer_.expires_after(offset_);
+            do_wait();
+        }
+
+        void do_wait()
+        {
+            timer_.async_wait(
+            [self = shared_this()](error_code_t ec)
+            {
+                self->on_wait(ec);
+            });
+        }
+
+        void on_wait(error_code_t ec)
+        {
+            if (ec || ! socket_.is_open())
+                return;
+
+            send(mode_type::request, room_, std::to_string(now_ns()));
+            ++stats_.sent;
+            timer_.expires_after(interval_);
+            do_wait();
+        }
+
+        void do_read()
+        {
+            auto [data, size] = decoder_.prepare();
+            if (! data)
+                return on_read(std::make_error_code(std::errc::message_size), 0);
+
+            socket_.async_read_some(net::buffer(data, size),
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                self->on_read(ec, bytes_transferred);
+            });
+        }
+
+        // a delivered line is "<sent ns>", or "<time> <sent ns>" from a server run with -p
+        void on_read(error_code_t ec, size_t bytes_transferred)
+        {
+            if (ec)
+            {
+                fail(ec, "read");
+                return do_close();
+            }
+
+            auto now = now_ns();
+            size_t received = 0;
+            decoder_.commit(bytes_transferred);
+            while (auto view = decoder_.next())
+            {
+                if (static_cast<mode_type>(view->header.mode()) == mode_type::ping)
+                {
+                    send(mode_type::pong, 0, "");
+                    continue;
+                }
+
+                receiver_.decode_message(view->data + header_size(), view->size - header_size());
+                auto& line = receiver_.message()->message();
+                auto sent = std::strtoll(line.c_str() + line.rfind(' ') + 1, nullptr, 10);
+                stats_.latencies.push_back(static_cast<uint32_t>((now - sent) / 1000));
+                ++received;
+            }
+            decoder_.consume();
+
+            stats_.received.fetch_add(received, std::memory_order_relaxed);
+            do_read();
+        }
+
+    private:
+        void send(mode_type mode, uint16_t room, const std::string& line)
+        {
+            shared_buffer buffer;
+            if (mode == mode_type::pong)
+            {
+                auto pong = control_header(mode);
+                buffer = shared_buffer(pong.size());
+                std::copy(pong.begin(), pong.end(), buffer.data());
+            }
+            else
+            {
+                auto& header = sender_.header();
+                header.set_mode(static_cast<uint8_t>(mode));
+                header.set_service(room);
+                header.set_seq(seq_++);
+                sender_.message()->set_message(line);
+                sender_.pack(buffer);
+            }
+
+            if (lines_.push(std::move(buffer)))
+                do_write();
+        }
+
+        void do_write()
+        {
+            net::async_write(socket_, lines_.flush(),
+            [this, self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                if (ec)
+                {
+                    fail(ec, "write");
+                    return do_close();
+                }
+
+                if (lines_.written())
+                    do_write();
+            });
+        }
+
+        void do_close()
+        {
+            error_code_t ec;
+            timer_.cancel();
+            socket_.close(ec);
+        }
+
+        socket_t socket_;
+        net::steady_timer timer_;
+        stats& stats_;
+        uint16_t room_;
+        std::chrono::microseconds interval_;
+        std::chrono::microseconds offset_;
+        uint32_t seq_ = 0;
+        decoder decoder_;
+        carrier_t sender_;
+        carrier_t receiver_;
+        outbox<shared_buffer> lines_;
+};
+
+#endif
@@ -3,6 +3,8 @@
 
 #include <deque>
 #include <net.hpp>
+#include <heartbeat.hpp>
+#include <coarse_clock.hpp>
 
 class chat_client
 {
@@ -77,9 +79,18 @@ class chat_client
 
         void on_read_message(error_code_t ec, size_t bytes_transferred)
         {
-            if (! ec)
+            if (! ec && static_cast<mode_type>(receiver_.header().mode()) == mode_type::ping)
+            {
+                auto pong = control_header(mode_type::pong);
+                write(buffer_t(pong.begin(), pong.end()));
+                do_read_header();
+            }
+            else if (! ec)
             {
+                // the server stamps the second it got the line in res
                 receiver_.decode_message(buffer_);
+                if (auto second = receiver_.header().res())
+                    std::cout << '<' << coarse_clock::format(second) << "> ";
                 std::cout << receiver_.message()->message() << std::endl;
                 do_read_header();
             }
@@ -1,61 +1,409 @@
 #ifndef CHAT_SERVER_ASYNC_HPP
 #define CHAT_SERVER_ASYNC_HPP
 
-#include <set>
 #include <list>
 #include <deque>
-#include <ctime>
+#include <chrono>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
 #include <net.hpp>
+#include <outbox.hpp>
+#include <runtime.hpp>
+#include <heartbeat.hpp>
+#include <coarse_clock.hpp>
 
-std::string timestamp()
+inline shared_buffer copy(const byte_t* data, size_t size)
 {
-    char date[80];
-    timespec tp;
-    clock_gettime(CLOCK_REALTIME, &tp);
-    tm* timeinfo = localtime(static_cast<time_t*>(&tp.tv_sec));
-    strftime(date, 80, "%Y-%m-%d-%H:%M:%S", timeinfo);
-    return std::string(date);
+    shared_buffer buffer(size);
+    std::copy_n(data, size, buffer.data());
+    return buffer;
+}
+
+// reads the varint at data, returns the bytes it took or 0 if it does not end before end
+inline size_t read_varint(const byte_t* data, const byte_t* end, uint64_t& value)
+{
+    value = 0;
+    for (size_t i = 0; i < 10 && data + i < end; ++i)
+    {
+        value |= static_cast<uint64_t>(data[i] & byte_t{0x7f}) << (7 * i);
+        if ((data[i] & byte_t{0x80}) == byte_t{0})
+            return i + 1;
+    }
+    return 0;
+}
+
+inline size_t write_varint(byte_t* data, uint64_t value)
+{
+    size_t i = 0;
+    for (; value >= 0x80; value >>= 7)
+        data[i++] = static_cast<byte_t>(value | 0x80);
+    data[i++] = static_cast<byte_t>(value);
+    return i;
+}
+
+// copies a packed pb::carrier frame with "<time> " spliced in front of its message
+// field. the payload is walked at the wire level, the fields around the message
+// are copied as they are, so nothing is parsed or serialized; a payload that does
+// not scan is copied unchanged.
+inline shared_buffer prefix_timestamp(const byte_t* data, size_t size, std::string_view time)
+{
+    constexpr uint64_t tag = (12 << 3) | 2;
+    const byte_t* payload = data + header_size();
+    const byte_t* end = data + size;
+    const byte_t* field = end;
+    const byte_t* value = end;
+    uint64_t length = 0;
+    for (auto p = payload; p != end;)
+    {
+        uint64_t key, n = 0;
+        size_t used = read_varint(p, end, key);
+        if (used == 0)
+            return copy(data, size);
+
+        auto next = p + used;
+        auto wire = key & 7;
+        if (wire == 0)
+            used = read_varint(next, end, n);
+        else if (wire == 1 || wire == 5)
+            used = wire == 1 ? 8 : 4;
+        else if (wire == 2)
+        {
+            used = read_varint(next, end, n);
+            if (key == tag)
+            {
+                field = p;
+                value = next + used;
+                length = n;
+            }
+        }
+        else
+            used = 0;
+
+        if (used == 0 || static_cast<uint64_t>(end - next) < used + (wire == 2 ? n : 0))
+            return copy(data, size);
+        p = next + used + (wire == 2 ? n : 0);
+    }
+
+    byte_t varint[10];
+    size_t prefix = time.size() + 3;
+    size_t head = write_varint(varint, length + prefix);
+    size_t payload_size = (field - payload) + 1 + head + prefix + (end - value);
+
+    protocol header;
+    header.decode(data);
+    header.set_length(payload_size);
+
+    shared_buffer buffer(header_size() + payload_size);
+    header.encode(buffer.data());
+    auto out = std::copy(payload, field, buffer.data() + header_size());
+    *out++ = static_cast<byte_t>(tag);
+    out = std::copy_n(varint, head, out);
+    *out++ = byte_t{'<'};
+    out = std::copy_n(reinterpret_cast<const byte_t*>(time.data()), time.size(), out);
+    *out++ = byte_t{'>'};
+    *out++ = byte_t{' '};
+    std::copy(value, end, out);
+    return buffer;
 }
 
 class char_user
 {
     public:
         virtual ~char_user() {}
-        virtual void deliver(const buffer_t& buffer) = 0;
+
+        // called on the io_context thread that owns the user's shard
+        virtual void deliver(const shared_buffer& buffer) = 0;
 };
 
 using user_t = std::shared_ptr<char_user>;
+using room_t = uint16_t;
+using batch_t = std::vector<std::pair<room_t, shared_buffer>>;
+
+// the latest packed lines of a room, bounded by their total size; the buffers
+// are the ones that were delivered, shared with every queue and shard holding them
+class history_ring
+{
+    public:
+        explicit history_ring(size_t capacity) : capacity_(capacity)
+        {
+        }
 
+        void push(const shared_buffer& buffer)
+        {
+            if (capacity_ == 0)
+                return;
+
+            ring_.push_back(buffer);
+            bytes_ += buffer.size();
+            while (bytes_ > capacity_)
+            {
+                bytes_ -= ring_.front().size();
+                ring_.pop_front();
+            }
+        }
+
+        size_t bytes() const
+        {
+            return bytes_;
+        }
+
+        // the newest lines that fit in bytes, oldest first
+        template <typename F>
+        void latest(size_t bytes, F&& f) const
+        {
+            auto begin = ring_.end();
+            size_t total = 0;
+            while (begin != ring_.begin() && total + std::prev(begin)->size() <= bytes)
+                total += (--begin)->size();
+            std::for_each(begin, ring_.end(), std::forward<F>(f));
+        }
+
+    private:
+        size_t capacity_;
+        size_t bytes_ = 0;
+        std::deque<shared_buffer> ring_;
+};
+
+// members sit in slots so delivery walks a vector, a member keeps the slot it
+// was given and freed slots are reused first
 class chat_room
 {
     public:
-        void join(user_t user)
+        explicit chat_room(size_t history_bytes) : history_(history_bytes)
+        {
+        }
+
+        uint32_t join(user_t user)
+        {
+            if (free_.empty())
+            {
+                members_.push_back(std::move(user));
+                return members_.size() - 1;
+            }
+
+            uint32_t slot = free_.back();
+            free_.pop_back();
+            members_[slot] = std::move(user);
+            return slot;
+        }
+
+        void leave(uint32_t slot)
+        {
+            members_[slot].reset();
+            free_.push_back(slot);
+        }
+
+        bool vacant() const
+        {
+            return free_.size() == members_.size();
+        }
+
+        void deliver(const shared_buffer& buffer)
+        {
+            history_.push(buffer);
+            for (auto& user: members_)
+                if (user)
+                    user->deliver(buffer);
+        }
+
+        const history_ring& history() const
+        {
+            return history_;
+        }
+
+    private:
+        std::vector<user_t> members_;
+        std::vector<uint32_t> free_;
+        history_ring history_;
+};
+
+// one per io_context, holding the rooms as seen by the sessions of that thread.
+// join, leave and delivery all run on the owning thread, so membership needs no
+// lock. a room is created by its first join, or with history by its first line.
+// without history a room goes with its last member; with it a room without
+// members here stays for its history until it has been quiet for linger, or
+// sooner, least recently active first, while the shard holds more than
+// history_total bytes of history.
+class chat_shard
+{
+    public:
+        using time_point_t = std::chrono::steady_clock::time_point;
+
+        static constexpr std::chrono::minutes linger{5};
+
+        chat_shard(net::io_context& ioc, size_t history_bytes, size_t history_total, const heartbeat_options& options) :
+        ioc_(ioc), history_bytes_(history_bytes), history_total_(history_total), beat_(ioc, options)
+        {
+            beat_.run();
+        }
+
+        heartbeat& beat()
+        {
+            return beat_;
+        }
+
+        uint32_t join(room_t id, user_t user)
+        {
+            auto& entry = find(id);
+            if (entry.idle != idle_.end())
+            {
+                idle_.erase(entry.idle);
+                entry.idle = idle_.end();
+            }
+            return entry.room.join(std::move(user));
+        }
+
+        void leave(room_t id, uint32_t slot)
+        {
+            auto it = rooms_.find(id);
+            if (it == rooms_.end())
+                return;
+
+            auto& entry = it->second;
+            entry.room.leave(slot);
+            if (! entry.room.vacant())
+                return;
+
+            if (! history_bytes_)
+                rooms_.erase(it);
+            else
+            {
+                auto now = std::chrono::steady_clock::now();
+                touch(id, entry, now);
+                sweep(now);
+            }
+        }
+
+        // what the room said last, as much as fits in bytes
+        template <typename F>
+        void history(room_t id, size_t bytes, F&& f) const
+        {
+            auto it = rooms_.find(id);
+            if (it != rooms_.end())
+                it->second.room.history().latest(bytes, std::forward<F>(f));
+        }
+
+        // one post per shard per batch, the loop over each room's members runs on the shard's thread
+        void transfer(std::shared_ptr<const batch_t> batch)
+        {
+            net::post(ioc_,
+            [this, batch = std::move(batch)]
+            {
+                if (! history_bytes_)
+                {
+                    for (auto& [room, buffer]: *batch)
+                        if (auto it = rooms_.find(room); it != rooms_.end())
+                            it->second.room.deliver(buffer);
+                    return;
+                }
+
+                auto now = std::chrono::steady_clock::now();
+                for (auto& [room, buffer]: *batch)
+                {
+                    auto& entry = find(room);
+                    size_t before = entry.room.history().bytes();
+                    entry.room.deliver(buffer);
+                    bytes_ = bytes_ + entry.room.history().bytes() - before;
+                    if (entry.room.vacant())
+                        touch(room, entry, now);
+                }
+                sweep(now);
+            });
+        }
+
+    private:
+        struct entry
+        {
+            chat_room room;
+            std::list<room_t>::iterator idle;   // place in idle_, end() while it has members here
+            time_point_t active;                // last line or leave while it had no members
+        };
+
+        entry& find(room_t id)
+        {
+            return rooms_.try_emplace(id, entry{ chat_room(history_bytes_), idle_.end(), {} }).first->second;
+        }
+
+        // a room without members moves to the back of idle_, so idle_ stays in the
+        // order the rooms were last active
+        void touch(room_t id, entry& entry, time_point_t now)
+        {
+            entry.active = now;
+            if (entry.idle == idle_.end())
+                entry.idle = idle_.insert(idle_.end(), id);
+            else
+                idle_.splice(idle_.end(), idle_, entry.idle);
+        }
+
+        void sweep(time_point_t now)
+        {
+            while (! idle_.empty())
+            {
+                auto it = rooms_.find(idle_.front());
+                if (bytes_ <= history_total_ && it->second.active > now - linger)
+                    break;
+
+                bytes_ -= it->second.room.history().bytes();
+                idle_.pop_front();
+                rooms_.erase(it);
+            }
+        }
+
+        net::io_context& ioc_;
+        size_t history_bytes_;
+        size_t history_total_;
+        size_t bytes_ = 0;
+        heartbeat beat_;
+        std::unordered_map<room_t, entry> rooms_;
+        std::list<room_t> idle_;
+};
+
+// every shard gets every batch. without history a shard drops the rooms it has
+// no members in, with it every shard keeps the history of the rooms that are
+// active, so a joiner on any thread catches up. a sender's messages arrive in the order it
+// sent them, messages of different senders to one room may interleave
+// differently in each shard.
+class chat_rooms
+{
+    public:
+        explicit chat_rooms(size_t history_bytes = 64 * 1024, size_t history_total = 64 * 1024 * 1024, const heartbeat_options& options = {}) :
+        history_bytes_(history_bytes), history_total_(history_total), options_(options)
         {
-            group_.insert(user);
         }
 
-        void leave(user_t user)
+        // shards are added before the io_contexts start running and never removed
+        chat_shard& add(net::io_context& ioc)
         {
-            group_.erase(user);
+            return shards_.emplace_back(ioc, history_bytes_, history_total_, options_);
         }
 
-        void deliver(const buffer_t& buffer)
+        void transfer(batch_t batch)
         {
-            for (auto user: group_)
-                 user->deliver(buffer);
+            auto shared = std::make_shared<const batch_t>(std::move(batch));
+            for (auto& shard: shards_)
+                 shard.transfer(shared);
         }
 
     private:
-        std::set<user_t> group_;
+        size_t history_bytes_;
+        size_t history_total_;
+        heartbeat_options options_;
+        std::list<chat_shard> shards_;
 };
 
-class chat_session : public char_user, public std::enable_shared_from_this<chat_session>
+class chat_session : public char_user, public keepalive, public std::enable_shared_from_this<chat_session>
 {
     public:
-        chat_session(socket_t socket, chat_room& room) :
-        socket_(std::move(socket)), room_(room)
+        chat_session(socket_t socket, chat_shard& shard, chat_rooms& rooms, const outbox_limits& limits, bool prefix) :
+        socket_(std::move(socket)), shard_(shard), rooms_(rooms), prefix_(prefix), lines_(limits)
+        {
+        }
+
+        ~chat_session()
         {
+            shard_.beat().forget(*this);
         }
 
         std::shared_ptr<chat_session> shared_this()
@@ -63,119 +411,256 @@ class chat_session : public char_user, public std::enable_shared_from_this<chat_
             return shared_from_this();
         }
     
+        // every session starts in room 0, so clients that never join keep talking
+        // to each other there
         void start()
         {
-            room_.join(shared_this());
-            do_read_header();
+            join(0);
+            shard_.beat().watch(*this);
+            do_read();
         }
 
-        void deliver(const buffer_t& buffer)
+        void deliver(const shared_buffer& line)
         {
-            bool write_in_progress = !lines_.empty();
-            lines_.push_back(buffer);
-            if (! write_in_progress)
+            if (lines_.push(line))
                 do_write();
+            else if (lines_.overflow())
+                do_close();
         }
 
-    private:
-        void do_read_header()
+        void ping()
         {
-            buffer_.resize(header_size());
-            net::async_read(socket_, net::buffer(buffer_),
-            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
-            {
-                self->on_read_header(ec, bytes_transferred);
-            });
+            send(mode_type::ping);
         }
 
-        void on_read_header(error_code_t ec, size_t bytes_transferred)
+        void expire()
         {
-            if (! ec)
-                do_read_message();
-            else
-                room_.leave(shared_this());
+            do_close();
         }
 
-        void do_read_message()
+        std::shared_ptr<keepalive> ref()
         {
-            size_t size = carrier_.decode_header(buffer_);
-            net::async_read(socket_, net::buffer(std::addressof(buffer_[header_size()]), size),
+            return weak_from_this().lock();
+        }
+
+    private:
+        void do_read()
+        {
+            auto [data, size] = decoder_.prepare();
+            if (! data)
+                return on_read(std::make_error_code(std::errc::message_size), 0);
+
+            socket_.async_read_some(net::buffer(data, size),
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
-                self->on_read_message(ec, bytes_transferred);
+                self->on_read(ec, bytes_transferred);
             });
         }
 
-        void on_read_message(error_code_t ec, size_t bytes_transferred)
+        // every line decoded in one read goes to the shards as one batch
+        void on_read(error_code_t ec, size_t bytes_transferred)
         {
-            if (! ec)
+            if (ec)
+                return leave();
+
+            shard_.beat().touch(*this);
+            batch_t batch;
+            decoder_.commit(bytes_transferred);
+            while (auto view = decoder_.next())
             {
-                prepend_timestamp();
-                room_.deliver(buffer_);
-                do_read_header();
+                auto mode = static_cast<mode_type>(view->header.mode());
+                if (mode == mode_type::ping)
+                    send(mode_type::pong);
+                if (mode == mode_type::ping || mode == mode_type::pong)
+                    continue;
+
+                room_t room = view->header.service();
+                if (mode == mode_type::subscribe)
+                    join(room);
+                else if (mode == mode_type::unsubscribe)
+                    leave(room);
+                else if (joined(room))
+                    batch.emplace_back(room, stamp(view->data, view->size));
             }
-            else
-                room_.leave(shared_this());
+            decoder_.consume();
+
+            if (! batch.empty())
+                rooms_.transfer(std::move(batch));
+            do_read();
         }
 
         void do_write()
         {
-            net::async_write(socket_, net::buffer(lines_.front()),
+            net::async_write(socket_, lines_.flush(),
             [this, self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
                 if (! ec)
                 {
-                    lines_.pop_front();
-                    if (! lines_.empty())
+                    if (lines_.written())
                         do_write();
                 }
                 else
-                    room_.leave(shared_this());
+                    leave();
             });
         }
 
-        void prepend_timestamp()
+        void send(mode_type mode)
         {
-            carrier_.decode_message(buffer_);
-            auto data = carrier_.message();
-            std::string time("<");
-            time.append(timestamp());
-            time.append(1, '>');
-            time.append(1, ' ');
-            time.append(data->message());
-            data->set_message(time);
-            carrier_.pack(buffer_);
+            auto header = control_header(mode);
+            shared_buffer buffer(header.size());
+            std::copy(header.begin(), header.end(), buffer.data());
+            if (lines_.push(std::move(buffer)))
+                do_write();
+        }
+
+        // a subscribe frame joins the room in its service field, an unsubscribe
+        // leaves it, and a message is delivered to that room if the sender is in it.
+        // a joiner is first sent the room's history, queued at once so it goes out
+        // in gather writes, limited to what the queue has room for.
+        void join(room_t room)
+        {
+            if (joined(room))
+                return;
+
+            joined_.emplace_back(room, shard_.join(room, shared_this()));
+            bool idle = false;
+            shard_.history(room, lines_.room(),
+            [this, &idle](const shared_buffer& buffer)
+            {
+                idle = lines_.push(buffer);
+            });
+            if (idle)
+                do_write();
+        }
+
+        void leave(room_t room)
+        {
+            auto it = std::find_if(joined_.begin(), joined_.end(), [room](auto& entry){ return entry.first == room; });
+            if (it == joined_.end())
+                return;
+
+            shard_.leave(room, it->second);
+            joined_.erase(it);
+        }
+
+        bool joined(room_t room) const
+        {
+            return std::any_of(joined_.begin(), joined_.end(), [room](auto& entry){ return entry.first == room; });
+        }
+
+        // the rooms hold the session, leaving all of them lets it go
+        void leave()
+        {
+            for (auto& [room, slot]: joined_)
+                shard_.leave(room, slot);
+            joined_.clear();
+        }
+
+        // a room may be iterating its members, so only close here and let the
+        // failing read leave them
+        void do_close()
+        {
+            error_code_t ec;
+            socket_.shutdown(net::socket_base::shutdown_both, ec);
+            socket_.close(ec);
+        }
+
+        // the second a line arrived goes in the header's res field and the payload
+        // is passed on as it came; with prefix the time is written in front of the
+        // text instead, for clients that only print the message
+        shared_buffer stamp(const byte_t* data, size_t size)
+        {
+            if (prefix_)
+                return prefix_timestamp(data, size, coarse_clock::text());
+
+            auto buffer = copy(data, size);
+            protocol::patch_res(buffer.data(), coarse_clock::seconds());
+            return buffer;
         }
 
         socket_t socket_;
-        chat_room& room_;
-        buffer_t buffer_;
-        carrier_t carrier_;
-        std::deque<buffer_t> lines_;
+        chat_shard& shard_;
+        chat_rooms& rooms_;
+        std::vector<std::pair<room_t, uint32_t>> joined_;
+        bool prefix_;
+        decoder decoder_;
+        outbox<shared_buffer> lines_;
 };
 
-class listener
+class listener : public std::enable_shared_from_this<listener>
 {
     public:
-        listener(net::io_context& io_context, const endpoint_t& endpoint) : acceptor_(io_context, endpoint)
+        listener(net::io_context& ioc, const endpoint_t& endpoint, chat_shard& shard, chat_rooms& rooms, const outbox_limits& limits, bool prefix, bool reuseport = false) :
+        acceptor_(ioc), shard_(shard), rooms_(rooms), limits_(limits), prefix_(prefix)
         {
-            do_accept();
+            error_code_t ec;
+            acceptor_.open(endpoint.protocol(), ec);
+            if (ec)
+            {
+                fail(ec, "open");
+                return;
+            }
+
+            acceptor_.set_option(net::socket_base::reuse_address(true), ec);
+            if (ec)
+            {
+                fail(ec, "set_option");
+                return;
+            }
+
+            if (reuseport)
+                acceptor_.set_option(reuse_port(true), ec);
+            if (ec)
+            {
+                fail(ec, "set_option");
+                return;
+            }
+
+            acceptor_.bind(endpoint, ec);
+            if (ec)
+            {
+                fail(ec, "bind");
+                return;
+            }
+
+            acceptor_.listen(net::socket_base::max_listen_connections, ec);
+            if (ec)
+            {
+                fail(ec, "listen");
+                return;
+            }
+        }
+
+        void run()
+        {
+            if (acceptor_.is_open())
+                do_accept();
         }
 
     private:
         void do_accept()
         {
             acceptor_.async_accept(
-            [this](error_code_t ec, socket_t socket)
+            [self = shared_from_this()](error_code_t ec, socket_t socket)
             {
-                if (!ec)
-                    std::make_shared<chat_session>(std::move(socket), room_)->start();
-                do_accept();
+                self->on_accept(ec, std::move(socket));
             });
         }
 
+        void on_accept(error_code_t ec, socket_t socket)
+        {
+            if (ec)
+                fail(ec, "accept");
+            else
+                std::make_shared<chat_session>(std::move(socket), shard_, rooms_, limits_, prefix_)->start();
+            do_accept();
+        }
+
         tcp::acceptor acceptor_;
-        chat_room room_;
+        chat_shard& shard_;
+        chat_rooms& rooms_;
+        outbox_limits limits_;
+        bool prefix_;
 };
 
 #endif
@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <chat_bench_async.hpp>
+
+int main(int argc, char* argv[])
+{
+    if (argc != 7)
+    {
+        std::cerr << "Usage:   " << argv[0] << " <host> <port> <clients> <rooms> <lines per second per client> <seconds>\n"
+                  << "Example: " << argv[0] << " 127.0.0.1 8080 2000 100 5 10\n";
+        return 1;
+    }
+
+    auto const host = argv[1];
+    auto const port = argv[2];
+    auto const clients = static_cast<size_t>(std::stoul(argv[3]));
+    auto const rooms = std::max<size_t>(std::stoul(argv[4]), 1);
+    auto const rate = std::max<size_t>(std::stoul(argv[5]), 1);
+    auto const seconds = std::stoul(argv[6]);
+
+    net::io_context ioc{1};
+    tcp::resolver resolver{ioc};
+    auto const results = resolver.resolve(host, port);
+
+    // clients are spread over rooms 1..rooms and their sends over the interval
+    stats stats;
+    auto const interval = std::chrono::microseconds(1000000 / rate);
+    for (size_t i = 0; i < clients; ++i)
+        std::make_shared<session>(ioc, stats, 1 + i % rooms, interval, interval * i / clients)->run(results);
+
+    std::thread t([&ioc]{ ioc.run(); });
+
+    size_t sent = 0;
+    size_t received = 0;
+    for (size_t i = 0; i < seconds; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        std::cout << stats.connected.load() << " connected, " << stats.sent.load() - sent << " lines/sec, "
+                  << stats.received.load() - received << " deliveries/sec\n";
+        sent = stats.sent.load();
+        received = stats.received.load();
+
+        // the first second, with its connects and joins, is warm-up
+        if (i == 0)
+            net::post(ioc, [&stats]{ stats.latencies.clear(); });
+    }
+
+    ioc.stop();
+    t.join();
+
+    auto& latencies = stats.latencies;
+    if (latencies.empty())
+        return 1;
+
+    auto percentile = [&latencies](double p)
+    {
+        auto it = latencies.begin() + static_cast<size_t>(p * (latencies.size() - 1));
+        std::nth_element(latencies.begin(), it, latencies.end());
+        return *it;
+    };
+
+    std::cout << latencies.size() << " deliveries, latency p50 " << percentile(0.5) << " us, p99 "
+              << percentile(0.99) << " us, max " << percentile(1.0) << " us\n";
+
+    return 0;
+}
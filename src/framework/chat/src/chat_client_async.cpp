@@ -14,15 +14,32 @@ int main(int argc, char* argv[])
 
     buffer_t buffer_;
     carrier_t sender_;
-    auto header = sender_.header();
+    auto& header = sender_.header();
     auto message = sender_.message();
 
+    // /join <room> and /leave <room> change membership, lines go to the room
+    // joined last, room 0 to begin with
     uint32_t seq = 0;
+    uint16_t room = 0;
     std::string line;
     while (std::getline(std::cin, line))
     {
-        header->set_seq(seq++);
+        header.set_mode(static_cast<uint8_t>(mode_type::request));
         message->set_message(line);
+        if (line.rfind("/join ", 0) == 0 || line.rfind("/leave ", 0) == 0)
+        {
+            bool join = line[1] == 'j';
+            uint16_t target = std::atoi(line.c_str() + line.find(' ') + 1);
+            header.set_mode(static_cast<uint8_t>(join ? mode_type::subscribe : mode_type::unsubscribe));
+            header.set_service(target);
+            message->clear_message();
+            if (join)
+                room = target;
+        }
+        else
+            header.set_service(room);
+
+        header.set_seq(seq++);
         sender_.pack(buffer_);
         c.write(buffer_);
     }
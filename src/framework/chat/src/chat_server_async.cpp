@@ -1,23 +1,78 @@
+#include <unistd.h>
 #include <chat_server_async.hpp>
 
 int main(int argc, char* argv[])
 {
-    if (argc < 2)
+    auto mode = to_runtime_mode("reuseport");
+    auto policy = to_overflow_policy("drop_oldest");
+    size_t high = 4096;
+    size_t threads = std::thread::hardware_concurrency();
+    bool prefix = false;
+    size_t history = 64;
+    size_t history_total = 64;
+    heartbeat_options beat;
+
+    int opt;
+    bool usage = false;
+    while ((opt = getopt(argc, argv, "m:n:o:w:h:H:k:t:p")) != -1)
     {
-        std::cerr << "Usage: " << argv[0] << " <port> ...\n";
+        if (opt == 'm')
+            mode = to_runtime_mode(optarg);
+        else if (opt == 'n')
+            threads = std::stoul(optarg);
+        else if (opt == 'o')
+            policy = to_overflow_policy(optarg);
+        else if (opt == 'w')
+            high = std::stoul(optarg);
+        else if (opt == 'h')
+            history = std::stoul(optarg);
+        else if (opt == 'H')
+            history_total = std::stoul(optarg);
+        else if (opt == 'p')
+            prefix = true;
+        else if (opt == 'k')
+            beat.idle = std::chrono::seconds(std::stoul(optarg));
+        else if (opt == 't')
+            beat.timeout = std::chrono::seconds(std::stoul(optarg));
+        else
+            usage = true;
+    }
+
+    if (usage || optind >= argc)
+    {
+        std::cerr << "Usage: " << argv[0] << " [-m <reuseport|pinned>] [-n <threads>] [-o <drop_oldest|coalesce|disconnect>] [-w <high watermark KB>]\n"
+                  << "       [-h <history KB per room, 0 off>] [-H <history MB per thread>] [-k <idle seconds before a ping, 0 off>] [-t <pong timeout seconds>] [-p] <port> ...\n"
+                  << "       -p writes the time in front of each line, for clients that do not read it from the header\n";
         return 1;
     }
 
-    net::io_context ioc;
-    std::list<listener> servers;
+    // a shard is owned by one io_context, so every thread needs its own
+    if (! mode || mode.value() == runtime_mode::shared)
+    {
+        std::cerr << "unsupported runtime mode\n";
+        return 1;
+    }
 
-    for (int i = 1; i < argc; ++i)
+    if (! policy)
     {
-        endpoint_t endpoint(tcp::v4(), std::atoi(argv[i]));
-        servers.emplace_back(ioc, endpoint);
+        std::cerr << "unknown overflow policy\n";
+        return 1;
     }
 
-    ioc.run();
+    auto const limits = watermarks(policy.value(), high * 1024, 4096);
+
+    chat_rooms rooms(history * 1024, history_total * 1024 * 1024, beat);
+    runtime<net::io_context> rt{mode.value(), threads};
+    rt.listen([&](net::io_context& ioc, bool reuseport)
+    {
+        auto& shard = rooms.add(ioc);
+        for (int i = optind; i < argc; ++i)
+        {
+            endpoint_t endpoint(tcp::v4(), std::atoi(argv[i]));
+            std::make_shared<listener>(ioc, endpoint, shard, rooms, limits, prefix, reuseport)->run();
+        }
+    });
+    rt.run();
 
     return 0;
 }
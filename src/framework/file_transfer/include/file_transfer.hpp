@@ -1,6 +1,7 @@
 #ifndef FILE_TRANSFER_HPP
 #define FILE_TRANSFER_HPP
 
+#include <limits>
 #include <cstdint>
 #include <fstream>
 #include <filesystem>
@@ -47,6 +48,9 @@ struct is_container<
 template <typename T>
 concept bool is_container_v = is_container<T>::value;
 
+// a file travels as chunks: the first one names it with a tag, every chunk says
+// where in the file it goes, and the last one completes it. an acknowledgement
+// carries the tag back.
 class protocol
 {
     public:
@@ -72,11 +76,56 @@ class protocol
             tagsize_ = tagsize;
         }
 
+        uint32_t id() const
+        {
+            return id_;
+        }
+
+        void set_id(uint32_t id)
+        {
+            id_ = id;
+        }
+
+        bool last() const
+        {
+            return flags_ & 1;
+        }
+
+        void set_last(bool last)
+        {
+            flags_ = last ? flags_ | 1 : flags_ & ~1u;
+        }
+
+        uint32_t flags() const
+        {
+            return flags_;
+        }
+
+        void set_flags(uint32_t flags)
+        {
+            flags_ = flags;
+        }
+
+        uint64_t offset() const
+        {
+            return offset_;
+        }
+
+        void set_offset(uint64_t offset)
+        {
+            offset_ = offset;
+        }
+
     private:
-        length_t length_;
-        length_t tagsize_;
+        length_t length_ = 0;    // tag + chunk bytes after the header
+        length_t tagsize_ = 0;   // only the first chunk of a file has a tag
+        uint32_t id_ = 0;        // file within the connection
+        uint32_t flags_ = 0;     // last chunk
+        uint64_t offset_ = 0;    // where the chunk goes in the file
 };
 
+static_assert(sizeof(protocol) == 24);
+
 inline constexpr size_t header_size()
 {
     return sizeof(protocol);
@@ -86,6 +135,18 @@ inline constexpr size_t length_size()
 {
     return sizeof(length_t);
 }
+
+// what a client reads from disk per frame, whatever the file size
+inline constexpr size_t chunk_size()
+{
+    return 256 * 1024;
+}
+
+// the largest frame a server takes, a chunk and a tag of up to a path's length
+inline constexpr length_t max_length()
+{
+    return chunk_size() + 4096;
+}
   
 class carrier 
 {
@@ -106,56 +167,44 @@ class carrier
             header_ = header;
         }
 
-        length_t decode_header(buffer_t& buffer_)
+        // the payload is only made room for when length is at most max
+        length_t decode_header(buffer_t& buffer_, length_t max = std::numeric_limits<length_t>::max())
         {
             size_t i = 0;
             length_t length = to_size<length_t>(buffer_, i);
             header_->set_length(length);
             header_->set_tagsize(to_size<length_t>(buffer_, i));
-            buffer_.resize(header_size() + length);
+            header_->set_id(to_size<uint32_t>(buffer_, i));
+            header_->set_flags(to_size<uint32_t>(buffer_, i));
+            header_->set_offset(to_size<uint64_t>(buffer_, i));
+            if (length <= max)
+                buffer_.resize(header_size() + length);
             return length;
         }
 
-        std::string decode_message(const buffer_t& buffer_, const fs::path& path = fs::path())
-        {
-            auto tagsize = header_->tagsize();
-            std::string tag(std::addressof(buffer_[header_size()]), tagsize);
-            fs::path file = path / tag;
-            if (header_->length() > tagsize)
-            {
-                fs::create_directories(file.parent_path());
-                std::ofstream ofs(file, std::ios::binary | std::ios::trunc);
-                auto offset = header_size() + tagsize;
-                ofs.write(std::addressof(buffer_[offset]), buffer_.size() - offset);
-            }
-            else if (tag[tagsize - 1] == '/')
-            {
-                auto dir = file.string();
-                dir.resize(dir.size() - 1);
-                fs::create_directories(dir);
-            }
-            else if (! path.empty())
-            {
-                fs::create_directories(file.parent_path());
-                std::ofstream(file, std::ios::binary | std::ios::trunc);
-            }
-            return tag;
+        std::string decode_message(const buffer_t& buffer_)
+        {
+            return std::string(std::addressof(buffer_[header_size()]), header_->tagsize());
         }
 
-        template <typename T = std::string>
-        requires is_container_v<T>
-        void pack(buffer_t& buffer_, const std::string& tag, const T& buffer = T())
+        // lays out the header and the tag of a frame carrying size more bytes and
+        // returns where they go, so a chunk is read from disk straight into it
+        byte_t* prepare(buffer_t& buffer_, const std::string& tag, size_t size)
         {
-            length_t length = tag.size() + buffer.size();
+            length_t length = tag.size() + size;
             header_->set_length(length);
             header_->set_tagsize(tag.size());
             buffer_.resize(header_size() + length);
             encode_header(buffer_);
-            size_t i = header_size();
-            for (const auto& t : tag)
-                 buffer_[i++]= t;
-            for (const auto& b : buffer)
-                 buffer_[i++]= b;
+            std::copy(tag.begin(), tag.end(), buffer_.data() + header_size());
+            return buffer_.data() + header_size() + tag.size();
+        }
+
+        template <typename T = std::string>
+        requires is_container_v<T>
+        void pack(buffer_t& buffer_, const std::string& tag, const T& buffer = T())
+        {
+            std::copy(buffer.begin(), buffer.end(), prepare(buffer_, tag, buffer.size()));
         }
 
     private:
@@ -180,6 +229,9 @@ class carrier
             size_t i = 0;
             to_byte<length_t, byte_t>(buffer_, i, header_->length());
             to_byte<length_t, byte_t>(buffer_, i, header_->tagsize());
+            to_byte<uint32_t, byte_t>(buffer_, i, header_->id());
+            to_byte<uint32_t, byte_t>(buffer_, i, header_->flags());
+            to_byte<uint64_t, byte_t>(buffer_, i, header_->offset());
         }
 
     private:
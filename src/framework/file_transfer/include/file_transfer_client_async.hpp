@@ -2,6 +2,7 @@
 #define FILE_TRANSFER_CLIENT_ASYNC_HPP
 
 #include <deque>
+#include <atomic>
 #include <thread>
 #include <file_transfer.hpp>
 
@@ -56,33 +57,105 @@ class session
             net::post(ioc_,
             [this, file, tag]
             {
+                job job{ fs::path(), tag, std::string() };
                 if constexpr(std::is_same_v<T, fs::path>)
                 {
-                    buffer_t buff_;
-                    auto tag_ = to_buffer(buff_, file, tag);
-                    do_write(buff_, tag_);
+                    if (fs::is_regular_file(file))
+                        job.file = file;
+                    else if (fs::is_directory(file))
+                        job.tag.append(1, '/');
                 }
                 else
-                    do_write(file, tag);
+                    job.content = file;
+
+                jobs_.push_back(std::move(job));
+                if (jobs_.size() == 1)
+                    do_open();
             });
         }
 
     private:
-        std::string to_buffer(buffer_t& buffer, const fs::path& file, const std::string& path)
+        // a file on disk, or content from memory when file is empty
+        struct job
+        {
+            fs::path file;
+            std::string tag;
+            std::string content;
+        };
+
+        // files go one at a time, each as chunks read from disk straight into the
+        // frame, so the client holds one chunk however large the file
+        void do_open()
         {
-            auto path_ = path;
-            if (fs::is_regular_file(file))
+            auto& job = jobs_.front();
+            ++id_;
+            offset_ = 0;
+            size_ = job.content.size();
+            if (! job.file.empty())
             {
-                buffer.resize(fs::file_size(file));
-                if (! buffer.empty())
+                std::error_code ec;
+                size_ = fs::file_size(job.file, ec);
+                ifs_.open(job.file, std::ios::binary);
+                if (ec || ! ifs_)
                 {
-                    std::ifstream ifs(file, std::ios::binary);
-                    ifs.read(buffer.data(), buffer.size());
+                    fail(ec ? ec : std::make_error_code(std::errc::io_error), job.file.c_str());
+                    return do_next();
                 }
             }
-            else if (fs::is_directory(file))
-                path_.append(1, '/');
-            return path_;
+            do_write_chunk();
+        }
+
+        void do_write_chunk()
+        {
+            auto& job = jobs_.front();
+            size_t size = std::min<uint64_t>(chunk_size(), size_ - offset_);
+            auto& header = *sender_.header();
+            header.set_id(id_);
+            header.set_offset(offset_);
+            header.set_last(offset_ + size == size_);
+
+            auto data = sender_.prepare(chunk_, offset_ == 0 ? job.tag : std::string(), size);
+            if (job.file.empty())
+                std::copy_n(job.content.data() + offset_, size, data);
+            else if (! ifs_.read(data, size))
+            {
+                fail(std::make_error_code(std::errc::io_error), job.file.c_str());
+                return socket_.close();
+            }
+            offset_ += size;
+
+            net::async_write(socket_, net::buffer(chunk_),
+            [this](error_code_t ec, size_t bytes_transferred)
+            {
+                on_write_chunk(ec, bytes_transferred);
+            });
+        }
+
+        void on_write_chunk(error_code_t ec, size_t bytes_transferred)
+        {
+            if (ec)
+            {
+                fail(ec, "write");
+                return socket_.close();
+            }
+
+            if (offset_ < size_)
+                return do_write_chunk();
+
+            ifs_.close();
+            jobs_.pop_front();
+            if (! jobs_.empty())
+                do_open();
+        }
+
+        // a file that cannot be read is skipped and never acknowledged
+        void do_next()
+        {
+            jobs_.pop_front();
+            if (--nth == 0)
+                return socket_.close();
+            if (! jobs_.empty())
+                do_open();
         }
 
         void do_connect(const results_t& endpoints)
@@ -153,45 +226,20 @@ class session
             }
         }
 
-        template <typename T>
-        void do_write(const T& buffer, const std::string& tag)
-        {
-            buffer_t buff;
-            sender_.pack(buff, tag, buffer);
-            bool write_in_progress = ! buffers_.empty();
-            buffers_.push_back(buff);
-            if (! write_in_progress)
-                do_write();
-        }
-
-        void do_write()
-        {
-            net::async_write(socket_, net::buffer(buffers_.front()),
-            [this](error_code_t ec, size_t bytes_transferred)
-            {
-                if (! ec)
-                {
-                    buffers_.pop_front();
-                    if (! buffers_.empty())
-                        do_write();
-                }
-                else
-                {
-                    fail(ec, "write");
-                    socket_.close();
-                }
-            });
-        }
-
     private:
-        size_t nth = 0;
+        std::atomic<size_t> nth = 0;
         buffer_t buffer_;
+        buffer_t chunk_;
         carrier_t sender_;
         carrier_t receiver_;
         net::io_context& ioc_;
         socket_t socket_;
         tcp::resolver resolver_;
-        std::deque<buffer_t> buffers_;
+        std::deque<job> jobs_;
+        std::ifstream ifs_;
+        uint32_t id_ = 0;
+        uint64_t offset_ = 0;
+        uint64_t size_ = 0;
 };
 
 #endif
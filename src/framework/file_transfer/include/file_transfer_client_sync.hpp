@@ -47,18 +47,34 @@ class session
             transfer(std::string(), path.string());
         }
 
+        // a file is streamed in chunks read from disk straight into the frame, so
+        // one chunk is held however large the file; the tag comes back once the
+        // server has all of it
         template <typename T>
         void transfer(const T& file, const std::string& tag)
         {
+            ++id_;
             if constexpr(std::is_same_v<T, fs::path>)
             {
-                auto tag_ = to_buffer(file, tag);
-                carrier_.pack(buffer_, tag_, data_);
+                if (fs::is_regular_file(file))
+                {
+                    std::ifstream ifs(file, std::ios::binary);
+                    send(tag, fs::file_size(file),
+                    [&ifs, &file](byte_t* data, size_t size, uint64_t)
+                    {
+                        if (! ifs.read(data, size))
+                            throw fs::filesystem_error("read", file, std::make_error_code(std::errc::io_error));
+                    });
+                }
+                else
+                    send(fs::is_directory(file) ? tag + '/' : tag, 0, nullptr);
             }
             else
-                carrier_.pack(buffer_, tag, file);
-
-            net::write(socket_, net::buffer(buffer_));
+                send(tag, file.size(),
+                [&file](byte_t* data, size_t size, uint64_t offset)
+                {
+                    std::copy_n(file.data() + offset, size, data);
+                });
 
             buffer_.resize(header_size());
             net::read(socket_, net::buffer(buffer_));
@@ -69,30 +85,34 @@ class session
         }
 
     private:
-        std::string to_buffer(const fs::path& file, const std::string& path)
+        // fill(data, size, offset) puts the next size bytes of the file at data
+        template <typename F>
+        void send(const std::string& tag, uint64_t total, F&& fill)
         {
-            data_.clear();
-            auto path_ = path;
-            if (fs::is_regular_file(file))
+            uint64_t offset = 0;
+            do
             {
-                data_.resize(fs::file_size(file));
-                if (! data_.empty())
-                {
-                    std::ifstream ifs(file, std::ios::binary);
-                    ifs.read(data_.data(), data_.size());
-                }
+                size_t size = std::min<uint64_t>(chunk_size(), total - offset);
+                auto& header = *carrier_.header();
+                header.set_id(id_);
+                header.set_offset(offset);
+                header.set_last(offset + size == total);
+
+                auto data = carrier_.prepare(buffer_, offset == 0 ? tag : std::string(), size);
+                if constexpr(! std::is_null_pointer_v<std::decay_t<F>>)
+                    fill(data, size, offset);
+                net::write(socket_, net::buffer(buffer_));
+                offset += size;
             }
-            else if (fs::is_directory(file))
-                path_.append(1, '/');
-            return path_;
+            while (offset < total);
         }
 
     private:
         tcp::socket socket_;
         tcp::resolver resolver_;
         carrier_t carrier_;
-        buffer_t data_;
         buffer_t buffer_;
+        uint32_t id_ = 0;
 };
 
 #endif
@@ -1,16 +1,28 @@
 #ifndef FILE_TRANSFER_SERVER_ASYNC_HPP
 #define FILE_TRANSFER_SERVER_ASYNC_HPP
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <unordered_map>
 #include <file_transfer.hpp>
  
 class session : public std::enable_shared_from_this<session>
 {
     public:
+        // files a session may have open at once; the client sends one at a time
+        static constexpr size_t max_files = 64;
+
         session(socket_t socket, const fs::path& path) :
         socket_(std::move(socket)), strand_(socket_.get_executor()), path_(path)
         {
         }
 
+        ~session()
+        {
+            for (auto& [id, file] : files_)
+                ::close(file.fd);
+        }
+
         std::shared_ptr<session> shared_this()
         {
             return shared_from_this();
@@ -33,15 +45,20 @@ class session : public std::enable_shared_from_this<session>
 
         void on_read_header(error_code_t ec, size_t bytes_transferred)
         {
-            if (ec == net::error::eof)
+            if (ec)
                 return;
 
             do_read_message();
         }
 
+        // a frame is at most a chunk and its tag, so a session holds one chunk
+        // however large the file
         void do_read_message()
         {
-            size_t length = carrier_.decode_header(buffer_);
+            size_t length = carrier_.decode_header(buffer_, max_length());
+            if (length > max_length() || carrier_.header()->tagsize() > length)
+                return fail(std::make_error_code(std::errc::message_size), "read");
+
             net::async_read(socket_, net::buffer(std::addressof(buffer_[header_size()]), length), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
@@ -51,18 +68,24 @@ class session : public std::enable_shared_from_this<session>
         
         void on_read_message(error_code_t ec, size_t bytes_transferred)
         {
-            if (ec == net::error::eof)
+            if (ec)
+                return;
+
+            std::string tag = carrier_.decode_message(buffer_);
+            if (! store(tag))
                 return;
 
-            do_write();
+            if (carrier_.header()->last())
+                do_write(tag);
+            else
+                do_read_header();
         }
 
-        void do_write()
+        // the last chunk of a file is acknowledged with its tag
+        void do_write(std::string tag)
         {
-            auto tag = carrier_.decode_message(buffer_, path_);
-            auto end = tag.size() - 1;
-            if (tag[end] == '/')
-                tag.resize(end);
+            if (! tag.empty() && tag.back() == '/')
+                tag.pop_back();
             carrier_.pack(buffer_, tag);
             net::async_write(socket_, net::buffer(buffer_), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
@@ -80,11 +103,100 @@ class session : public std::enable_shared_from_this<session>
         }
 
     private:
+        static std::error_code last_error()
+        {
+            return std::error_code(errno, std::system_category());
+        }
+
+        // a tag ending in '/' is a directory. a chunk with a file's tag opens it,
+        // truncated when the chunk starts at 0 so a later offset can resume; every
+        // chunk is written at its offset and the last one closes the file and
+        // hands its tag back for the acknowledgement. a session that would hold
+        // more than max_files open is failed, which closes them all.
+        bool store(std::string& tag)
+        {
+            auto& header = *carrier_.header();
+            std::error_code ec;
+            if (! tag.empty() && tag.back() == '/')
+            {
+                fs::create_directories(path_ / tag.substr(0, tag.size() - 1), ec);
+                if (ec)
+                    fail(ec, "create_directories");
+                return ! ec;
+            }
+
+            if (! tag.empty())
+            {
+                if (files_.size() >= max_files && files_.find(header.id()) == files_.end())
+                {
+                    fail(std::make_error_code(std::errc::too_many_files_open), "chunk");
+                    return false;
+                }
+
+                auto file = path_ / tag;
+                fs::create_directories(file.parent_path(), ec);
+                int fd = ::open(file.c_str(), O_WRONLY | O_CREAT | (header.offset() ? 0 : O_TRUNC), 0644);
+                if (fd < 0)
+                {
+                    fail(last_error(), "open");
+                    return false;
+                }
+
+                auto [it, inserted] = files_.try_emplace(header.id(), file_t{ fd, tag });
+                if (! inserted)
+                {
+                    ::close(it->second.fd);
+                    it->second = { fd, tag };
+                }
+            }
+
+            auto it = files_.find(header.id());
+            if (it == files_.end())
+            {
+                fail(std::make_error_code(std::errc::bad_file_descriptor), "chunk");
+                return false;
+            }
+
+            auto& file = it->second;
+            const byte_t* data = std::addressof(buffer_[header_size()]) + tag.size();
+            size_t size = header.length() - tag.size();
+            off_t offset = header.offset();
+            while (size)
+            {
+                ssize_t n = ::pwrite(file.fd, data, size, offset);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0)
+                {
+                    fail(last_error(), "pwrite");
+                    return false;
+                }
+                data += n;
+                size -= n;
+                offset += n;
+            }
+
+            if (header.last())
+            {
+                ::close(file.fd);
+                tag = std::move(file.tag);
+                files_.erase(it);
+            }
+            return true;
+        }
+
+        struct file_t
+        {
+            int fd;
+            std::string tag;
+        };
+
         socket_t socket_;
         strand_t strand_;
         fs::path path_;
         buffer_t buffer_;
         carrier_t carrier_;
+        std::unordered_map<uint32_t, file_t> files_;
 };
 
 class listener : public std::enable_shared_from_this<listener>
@@ -0,0 +1,47 @@
+#ifndef COARSE_CLOCK_HPP
+#define COARSE_CLOCK_HPP
+
+#include <ctime>
+#include <string>
+#include <cstdint>
+#include <string_view>
+
+// wall clock for stamping messages. the second comes from the coarse realtime
+// clock, which is read without a syscall, and its text is formatted once per
+// second per thread instead of once per message.
+class coarse_clock
+{
+    public:
+        static uint32_t seconds()
+        {
+            timespec tp;
+            clock_gettime(CLOCK_REALTIME_COARSE, &tp);
+            return static_cast<uint32_t>(tp.tv_sec);
+        }
+
+        // the current second as format() gives it
+        static std::string_view text()
+        {
+            thread_local time_t second = 0;
+            thread_local std::string cached;
+
+            time_t now = seconds();
+            if (now != second)
+            {
+                second = now;
+                cached = format(now);
+            }
+            return cached;
+        }
+
+        // local time as %Y-%m-%d-%H:%M:%S
+        static std::string format(time_t second)
+        {
+            char date[80];
+            tm timeinfo;
+            localtime_r(&second, &timeinfo);
+            return std::string(date, strftime(date, sizeof(date), "%Y-%m-%d-%H:%M:%S", &timeinfo));
+        }
+};
+
+#endif
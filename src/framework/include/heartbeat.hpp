@@ -0,0 +1,189 @@
+#ifndef HEARTBEAT_HPP
+#define HEARTBEAT_HPP
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <net.hpp>
+#include <timer_wheel.hpp>
+
+// a peer that sent nothing for idle gets a ping and is closed if it stays silent
+// for timeout after it; an idle of zero turns the heartbeat off
+struct heartbeat_options
+{
+    std::chrono::milliseconds idle = std::chrono::seconds(30);
+    std::chrono::milliseconds timeout = std::chrono::seconds(10);
+    std::chrono::milliseconds tick = std::chrono::milliseconds(500);
+};
+
+// a ping or a pong is a bare header
+inline frame::header_t control_header(mode_type mode)
+{
+    protocol header{};
+    header.set_mode(static_cast<uint8_t>(mode));
+    frame::header_t data;
+    header.encode(data.data());
+    return data;
+}
+
+class heartbeat;
+
+// what a heartbeat keeps in each session it watches. ping() and expire() are
+// called from the heartbeat's tick, a session with a strand moves them onto it.
+class keepalive
+{
+    public:
+        virtual ~keepalive() {}
+
+        // send a ping frame
+        virtual void ping() = 0;
+
+        // the peer did not answer the ping, close the connection
+        virtual void expire() = 0;
+
+        // empty once the session is being destroyed
+        virtual std::shared_ptr<keepalive> ref() = 0;
+
+    private:
+        friend class heartbeat;
+
+        std::atomic<uint64_t> seen_ = 0;
+        uint64_t pinged_ = 0;
+        bool watched_ = false;
+        timer_wheel<keepalive*>::handle_t timer_;
+};
+
+// one per io_context: a single timer wheel holds the idle deadline of every
+// session instead of a timer per connection. reads only stamp the session with
+// the current tick, a deadline that fires early is pushed out by what is left.
+class heartbeat
+{
+    public:
+        heartbeat(net::io_context& ioc, const heartbeat_options& options) :
+        timer_(ioc), tick_(options.tick), idle_(ticks(options.idle)), timeout_(std::max<uint64_t>(ticks(options.timeout), 1)),
+        start_(std::chrono::steady_clock::now())
+        {
+        }
+
+        bool enabled() const
+        {
+            return idle_ != 0;
+        }
+
+        void run()
+        {
+            if (enabled())
+                do_tick();
+        }
+
+        // once the session is owned by a shared_ptr
+        void watch(keepalive& peer)
+        {
+            if (! enabled())
+                return;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            peer.seen_.store(wheel_.now(), std::memory_order_relaxed);
+            peer.timer_ = wheel_.schedule(idle_, &peer);
+            peer.watched_ = true;
+        }
+
+        // first thing in the session's destructor, a tick may be looking at it
+        void forget(keepalive& peer)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (peer.watched_)
+                wheel_.cancel(peer.timer_);
+            peer.watched_ = false;
+        }
+
+        // anything read from the peer is a sign of life
+        void touch(keepalive& peer)
+        {
+            peer.seen_.store(now_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+
+    private:
+        enum class action { none, ping, expire };
+
+        uint64_t ticks(std::chrono::milliseconds interval) const
+        {
+            return (interval + tick_ - std::chrono::milliseconds(1)) / tick_;
+        }
+
+        void do_tick()
+        {
+            timer_.expires_after(tick_);
+            timer_.async_wait(
+            [this](error_code_t ec)
+            {
+                on_tick(ec);
+            });
+        }
+
+        // the sessions are acted on, and let go of, outside the lock since their
+        // destructors take it
+        void on_tick(error_code_t ec)
+        {
+            if (ec)
+                return;
+
+            std::vector<std::pair<std::shared_ptr<keepalive>, action>> due;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                wheel_.advance((std::chrono::steady_clock::now() - start_) / tick_,
+                [this, &due](keepalive* peer)
+                {
+                    peer->watched_ = false;
+                    auto self = peer->ref();
+                    if (self)
+                        due.emplace_back(std::move(self), check(*peer));
+                });
+                now_.store(wheel_.now(), std::memory_order_relaxed);
+            }
+
+            for (auto& [peer, what] : due)
+            {
+                if (what == action::ping)
+                    peer->ping();
+                else if (what == action::expire)
+                    peer->expire();
+            }
+            do_tick();
+        }
+
+        action check(keepalive& peer)
+        {
+            uint64_t now = wheel_.now();
+            uint64_t seen = peer.seen_.load(std::memory_order_relaxed);
+            if (peer.pinged_)
+            {
+                if (seen < peer.pinged_)
+                    return action::expire;
+                peer.pinged_ = 0;
+            }
+
+            peer.watched_ = true;
+            if (now - seen < idle_)
+            {
+                peer.timer_ = wheel_.schedule(seen + idle_ - now, &peer);
+                return action::none;
+            }
+
+            peer.pinged_ = now;
+            peer.timer_ = wheel_.schedule(timeout_, &peer);
+            return action::ping;
+        }
+
+        net::steady_timer timer_;
+        std::chrono::milliseconds tick_;
+        uint64_t idle_;
+        uint64_t timeout_;
+        std::chrono::steady_clock::time_point start_;
+        std::mutex mutex_;
+        std::atomic<uint64_t> now_ = 0;
+        timer_wheel<keepalive*> wheel_;
+};
+
+#endif
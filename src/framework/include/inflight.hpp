@@ -0,0 +1,96 @@
+#ifndef INFLIGHT_HPP
+#define INFLIGHT_HPP
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <timer_wheel.hpp>
+
+template <typename T, size_t N = 64>
+class inflight
+{
+    public:
+        using entry_t = std::pair<uint32_t, T>;
+
+        uint32_t insert(uint32_t seq, T value, uint64_t ticks)
+        {
+            uint32_t id = sequence_.fetch_add(1, std::memory_order_relaxed);
+            auto& shard = shards_[id % N];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            record entry{entry_t(seq, std::move(value)), shard.timers.schedule(ticks, id)};
+            auto [it, inserted] = shard.entries.try_emplace(id, std::move(entry));
+            if (! inserted)
+            {
+                shard.timers.cancel(it->second.timer);
+                it->second = std::move(entry);
+            }
+            return id;
+        }
+
+        std::optional<entry_t> take(uint32_t id)
+        {
+            auto& shard = shards_[id % N];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.entries.find(id);
+            if (it == shard.entries.end())
+                return {};
+            shard.timers.cancel(it->second.timer);
+            entry_t entry = std::move(it->second.entry);
+            shard.entries.erase(it);
+            return entry;
+        }
+
+        template <typename F>
+        size_t expire(uint64_t now, F&& f)
+        {
+            std::vector<entry_t> expired;
+            for (auto& shard : shards_)
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.timers.advance(now,
+                [&](uint32_t id)
+                {
+                    auto it = shard.entries.find(id);
+                    expired.push_back(std::move(it->second.entry));
+                    shard.entries.erase(it);
+                });
+            }
+            for (auto& entry : expired)
+                 f(entry);
+            return expired.size();
+        }
+
+        size_t size()
+        {
+            size_t size = 0;
+            for (auto& shard : shards_)
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                size += shard.entries.size();
+            }
+            return size;
+        }
+
+    private:
+        struct record
+        {
+            entry_t entry;
+            typename timer_wheel<uint32_t>::handle_t timer;
+        };
+
+        struct alignas(64) shard
+        {
+            std::mutex mutex;
+            timer_wheel<uint32_t> timers;
+            std::unordered_map<uint32_t, record> entries;
+        };
+
+        std::atomic<uint32_t> sequence_ = 0;
+        std::array<shard, N> shards_;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef LRU_HPP
+#define LRU_HPP
+
+#include <list>
+#include <chrono>
+#include <optional>
+#include <unordered_map>
+
+// fixed-size cache that evicts the least recently used entry; entries also
+// expire after ttl so a changed value is picked up again
+template <typename Key, typename Value>
+class lru
+{
+    public:
+        using clock_type = std::chrono::steady_clock;
+
+        lru(size_t capacity, clock_type::duration ttl) : capacity_(capacity), ttl_(ttl)
+        {
+        }
+
+        std::optional<Value> get(const Key& key)
+        {
+            auto it = index_.find(key);
+            if (it == index_.end())
+                return {};
+
+            auto entry = it->second;
+            if (entry->expires < clock_type::now())
+            {
+                entries_.erase(entry);
+                index_.erase(it);
+                return {};
+            }
+
+            entries_.splice(entries_.begin(), entries_, entry);
+            return entry->value;
+        }
+
+        void put(const Key& key, Value value)
+        {
+            auto it = index_.find(key);
+            if (it != index_.end())
+            {
+                it->second->value = std::move(value);
+                it->second->expires = clock_type::now() + ttl_;
+                entries_.splice(entries_.begin(), entries_, it->second);
+                return;
+            }
+
+            if (entries_.size() >= capacity_)
+            {
+                index_.erase(entries_.back().key);
+                entries_.pop_back();
+            }
+            entries_.push_front({ key, std::move(value), clock_type::now() + ttl_ });
+            index_.emplace(key, entries_.begin());
+        }
+
+        void erase(const Key& key)
+        {
+            auto it = index_.find(key);
+            if (it == index_.end())
+                return;
+            entries_.erase(it->second);
+            index_.erase(it);
+        }
+
+        size_t size() const
+        {
+            return entries_.size();
+        }
+
+    private:
+        struct entry
+        {
+            Key key;
+            Value value;
+            clock_type::time_point expires;
+        };
+
+        size_t capacity_;
+        clock_type::duration ttl_;
+        std::list<entry> entries_;
+        std::unordered_map<Key, typename std::list<entry>::iterator> index_;
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <common.hpp>
 #include <carrier.hpp>
+#include <decoder.hpp>
 #include <carrier.pb.h>
 #include <experimental/net>
 
@@ -14,5 +15,11 @@ using error_code_t = std::error_code;
 using carrier_t = carrier<pb::carrier>;
 using results_t = tcp::resolver::results_type;
 using strand_t = net::strand<net::io_context::executor_type>;
+using buffers_t = std::array<net::const_buffer, 2>;
+
+inline buffers_t buffers(const frame& frame)
+{
+    return { net::buffer(frame.header()), net::buffer(frame.payload().data(), frame.payload().size()) };
+}
 
 #endif
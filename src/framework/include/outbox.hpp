@@ -0,0 +1,234 @@
+#ifndef OUTBOX_HPP
+#define OUTBOX_HPP
+
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <atomic>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <net.hpp>
+
+// what a session queue does once it crosses its high watermark
+// drop_oldest: discard the oldest unsent messages down to the low watermark
+// coalesce:    discard every unsent message but the latest
+// disconnect:  report overflow so the session closes the slow client
+enum class overflow_policy { drop_oldest, coalesce, disconnect };
+
+inline std::optional<overflow_policy> to_overflow_policy(std::string_view name)
+{
+    if (name == "drop_oldest")
+        return overflow_policy::drop_oldest;
+    if (name == "coalesce")
+        return overflow_policy::coalesce;
+    if (name == "disconnect")
+        return overflow_policy::disconnect;
+    return {};
+}
+
+// default is unbounded, for request/response queues that the peer paces itself
+struct outbox_limits
+{
+    overflow_policy policy = overflow_policy::drop_oldest;
+    size_t high_bytes = std::numeric_limits<size_t>::max();
+    size_t low_bytes = std::numeric_limits<size_t>::max();
+    size_t high_messages = std::numeric_limits<size_t>::max();
+    size_t low_messages = std::numeric_limits<size_t>::max();
+};
+
+// high watermarks with the low ones at a quarter, so shedding frees real room
+inline outbox_limits watermarks(overflow_policy policy, size_t high_bytes, size_t high_messages)
+{
+    return { policy, high_bytes, high_bytes / 4, high_messages, high_messages / 4 };
+}
+
+class outbox_stats
+{
+    public:
+        static void report(std::ostream& out)
+        {
+            size_t writes = writes_.load(std::memory_order_relaxed);
+            size_t messages = messages_.load(std::memory_order_relaxed);
+            out << "outbox: " << messages << " messages in " << writes << " writes, "
+                << (writes ? static_cast<double>(messages) / writes : 0) << " per write\n"
+                << "outbox: " << dropped_[0].load(std::memory_order_relaxed) << " dropped oldest, "
+                << dropped_[1].load(std::memory_order_relaxed) << " coalesced, "
+                << dropped_[2].load(std::memory_order_relaxed) << " disconnected\n";
+        }
+
+    protected:
+        static inline std::atomic<size_t> writes_;
+        static inline std::atomic<size_t> messages_;
+        static inline std::array<std::atomic<size_t>, 3> dropped_;
+};
+
+// outbound queue that hands everything pending to a single gather write, bounded
+// by a byte and a buffer count limit, instead of one async_write per message.
+// the unsent backlog is held under the watermarks of outbox_limits so a stalled
+// client costs at most high_bytes of memory, and an empty queue lets go of its
+// storage so an idle session costs nothing here. what a write is gathering from
+// sits apart from the unsent items, so queueing more never moves it.
+template <typename T>
+class outbox : public outbox_stats
+{
+    public:
+        using buffers_t = std::vector<net::const_buffer>;
+
+        explicit outbox(const outbox_limits& limits = {}, size_t max_bytes = 256 * 1024, size_t max_buffers = 64) :
+        limits_(limits), max_bytes_(max_bytes), max_buffers_(max_buffers)
+        {
+        }
+
+        // true if no write is in flight and the caller should start one with flush()
+        bool push(T item)
+        {
+            if (overflow_)
+                return false;
+
+            bytes_ += item.size();
+            items_.push_back(std::move(item));
+            if (bytes_ - inflight_bytes_ > limits_.high_bytes || unsent() > limits_.high_messages)
+                shed();
+            return sending_.empty() && ! overflow_;
+        }
+
+        // unsent bytes that can still be queued before the high watermark
+        size_t room() const
+        {
+            size_t pending = bytes_ - inflight_bytes_;
+            return pending < limits_.high_bytes ? limits_.high_bytes - pending : 0;
+        }
+
+        // the disconnect policy tripped, the session should close
+        bool overflow() const
+        {
+            return overflow_;
+        }
+
+        const buffers_t& flush()
+        {
+            gather_.clear();
+            sending_.reserve(std::min(max_buffers_, unsent()));
+            size_t bytes = 0;
+            for (; head_ < items_.size(); ++head_)
+            {
+                auto& item = items_[head_];
+                bytes += item.size();
+                if (! sending_.empty() && (bytes > max_bytes_ || gather_.size() + 2 > max_buffers_))
+                    break;
+                inflight_bytes_ += item.size();
+                sending_.push_back(std::move(item));
+                append(sending_.back());
+            }
+            compact();
+            writes_.fetch_add(1, std::memory_order_relaxed);
+            messages_.fetch_add(sending_.size(), std::memory_order_relaxed);
+            return gather_;
+        }
+
+        // drop what the last flush() wrote; true if more is queued
+        bool written()
+        {
+            bytes_ -= inflight_bytes_;
+            inflight_bytes_ = 0;
+            sending_.clear();
+            if (unsent())
+                return true;
+
+            // a session that writes a message at a time keeps its small buffers
+            if (items_.capacity() > 8)
+                items_.shrink_to_fit();
+            if (sending_.capacity() > 8)
+                sending_.shrink_to_fit();
+            if (gather_.capacity() > 8)
+            {
+                gather_.clear();
+                gather_.shrink_to_fit();
+            }
+            return false;
+        }
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        size_t size() const
+        {
+            return unsent() + sending_.size();
+        }
+
+    private:
+        size_t unsent() const
+        {
+            return items_.size() - head_;
+        }
+
+        // the front is popped by moving head_, and the popped slots are dropped once
+        // they are at least half the vector, so each item is moved at most once more
+        void compact()
+        {
+            if (head_ == items_.size())
+                items_.clear();
+            else if (head_ * 2 >= items_.size())
+                items_.erase(items_.begin(), items_.begin() + head_);
+            else
+                return;
+            head_ = 0;
+        }
+
+        // only unsent messages are dropped, the ones in flight belong to the socket
+        void shed()
+        {
+            if (limits_.policy == overflow_policy::disconnect)
+            {
+                if (! overflow_)
+                    dropped_[2].fetch_add(1, std::memory_order_relaxed);
+                overflow_ = true;
+                return;
+            }
+
+            bool coalesce = limits_.policy == overflow_policy::coalesce;
+            size_t dropped = 0;
+            while (unsent() > 1 && (coalesce ||
+                   bytes_ - inflight_bytes_ > limits_.low_bytes || unsent() > limits_.low_messages))
+            {
+                bytes_ -= items_[head_].size();
+                items_[head_++] = T();
+                ++dropped;
+            }
+            compact();
+            dropped_[coalesce ? 1 : 0].fetch_add(dropped, std::memory_order_relaxed);
+        }
+
+        void append(const frame& frame)
+        {
+            gather_.push_back(net::buffer(frame.header()));
+            if (frame.payload().size())
+                gather_.push_back(net::buffer(frame.payload().data(), frame.payload().size()));
+        }
+
+        void append(const buffer_t& buffer)
+        {
+            gather_.push_back(net::buffer(buffer));
+        }
+
+        void append(const shared_buffer& buffer)
+        {
+            gather_.push_back(net::buffer(buffer.data(), buffer.size()));
+        }
+
+        outbox_limits limits_;
+        size_t max_bytes_;
+        size_t max_buffers_;
+        size_t bytes_ = 0;
+        size_t inflight_bytes_ = 0;
+        size_t head_ = 0;
+        bool overflow_ = false;
+        std::vector<T> items_;
+        std::vector<T> sending_;
+        buffers_t gather_;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef RUNTIME_HPP
+#define RUNTIME_HPP
+
+#include <list>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <string_view>
+#include <common.hpp>
+
+// shared:    one io_context run by every thread, sessions hop threads behind strands
+// reuseport: one io_context and one SO_REUSEPORT acceptor per thread, the kernel
+//            balances connections and a session stays on the thread that accepted it
+// pinned:    reuseport with each thread bound to its own cpu
+enum class runtime_mode { shared, reuseport, pinned };
+
+inline std::optional<runtime_mode> to_runtime_mode(std::string_view name)
+{
+    if (name == "shared")
+        return runtime_mode::shared;
+    if (name == "reuseport")
+        return runtime_mode::reuseport;
+    if (name == "pinned")
+        return runtime_mode::pinned;
+    return {};
+}
+
+class reuse_port
+{
+    public:
+        explicit reuse_port(bool value) : value_(value)
+        {
+        }
+
+        template <typename Protocol>
+        int level(const Protocol&) const
+        {
+            return SOL_SOCKET;
+        }
+
+        template <typename Protocol>
+        int name(const Protocol&) const
+        {
+            return SO_REUSEPORT;
+        }
+
+        template <typename Protocol>
+        const void* data(const Protocol&) const
+        {
+            return &value_;
+        }
+
+        template <typename Protocol>
+        size_t size(const Protocol&) const
+        {
+            return sizeof(value_);
+        }
+
+    private:
+        int value_;
+};
+
+inline void pin_thread(pthread_t thread, size_t index)
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(index % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+    if (int ec = pthread_setaffinity_np(thread, sizeof(cpus), &cpus))
+        fail(std::error_code(ec, std::system_category()), "affinity");
+}
+
+template <typename Context>
+class runtime
+{
+    public:
+        runtime(runtime_mode mode, size_t threads) :
+        mode_(mode), threads_(std::max<size_t>(1, threads))
+        {
+            if (mode_ == runtime_mode::shared)
+                contexts_.emplace_back(static_cast<int>(threads_));
+            else
+                for (size_t i = 0; i < threads_; ++i)
+                    contexts_.emplace_back(1);
+        }
+
+        runtime_mode mode() const
+        {
+            return mode_;
+        }
+
+        // start(ioc, reuseport) is called once per io_context to set up its listener
+        template <typename F>
+        void listen(F&& start)
+        {
+            for (auto& ioc : contexts_)
+                start(ioc, mode_ != runtime_mode::shared);
+        }
+
+        void run()
+        {
+            std::vector<std::thread> v;
+            v.reserve(threads_ - 1);
+
+            auto ioc = contexts_.begin();
+            for (size_t i = 1; i < threads_; ++i)
+            {
+                if (mode_ != runtime_mode::shared)
+                    ++ioc;
+                v.emplace_back([&ioc = *ioc]{ ioc.run(); });
+                if (mode_ == runtime_mode::pinned)
+                    pin_thread(v.back().native_handle(), i);
+            }
+
+            if (mode_ == runtime_mode::pinned)
+                pin_thread(pthread_self(), 0);
+            contexts_.front().run();
+
+            for (auto& t : v)
+                t.join();
+        }
+
+    private:
+        runtime_mode mode_;
+        size_t threads_;
+        std::list<Context> contexts_;
+};
+
+#endif
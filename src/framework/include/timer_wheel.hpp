@@ -0,0 +1,113 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <list>
+#include <array>
+#include <cstdint>
+#include <algorithm>
+
+// hierarchical timing wheel: 4 levels of 64 slots, so timers up to 64^4 ticks
+// ahead cost O(1) to schedule and cancel and are cascaded at most 3 times
+template <typename T>
+class timer_wheel
+{
+    private:
+        static constexpr uint64_t bits = 6;
+        static constexpr uint64_t slots = 1 << bits;
+        static constexpr uint64_t levels = 4;
+        static constexpr uint64_t horizon = uint64_t(1) << (bits * levels);
+
+        struct node
+        {
+            T value;
+            uint64_t expiry;
+            uint64_t level;
+            uint64_t slot;
+        };
+
+        using slot_t = std::list<node>;
+
+    public:
+        using handle_t = typename slot_t::iterator;
+
+        uint64_t now() const
+        {
+            return now_;
+        }
+
+        size_t size() const
+        {
+            return size_;
+        }
+
+        handle_t schedule(uint64_t ticks, T value)
+        {
+            ticks = std::clamp<uint64_t>(ticks, 1, horizon - 1);
+            slot_t pending;
+            pending.push_back(node{std::move(value), now_ + ticks, 0, 0});
+            auto handle = pending.begin();
+            insert(pending, handle);
+            ++size_;
+            return handle;
+        }
+
+        void cancel(handle_t handle)
+        {
+            wheels_[handle->level][handle->slot].erase(handle);
+            --size_;
+        }
+
+        template <typename F>
+        void advance(uint64_t now, F&& expire)
+        {
+            while (now_ < now)
+                tick(expire);
+        }
+
+    private:
+        void insert(slot_t& from, handle_t handle)
+        {
+            uint64_t delta = handle->expiry - now_;
+            uint64_t level = 0;
+            while (level + 1 < levels && delta >= (uint64_t(1) << (bits * (level + 1))))
+                ++level;
+            handle->level = level;
+            handle->slot = (handle->expiry >> (bits * level)) & (slots - 1);
+            auto& to = wheels_[level][handle->slot];
+            to.splice(to.end(), from, handle);
+        }
+
+        void cascade(uint64_t level)
+        {
+            auto& from = wheels_[level][(now_ >> (bits * level)) & (slots - 1)];
+            while (! from.empty())
+                insert(from, from.begin());
+        }
+
+        template <typename F>
+        void tick(F& expire)
+        {
+            ++now_;
+            uint64_t level = 1;
+            while (level < levels && (now_ & ((uint64_t(1) << (bits * level)) - 1)) == 0)
+                ++level;
+            while (--level > 0)
+                cascade(level);
+
+            auto& due = wheels_[0][now_ & (slots - 1)];
+            while (! due.empty())
+            {
+                slot_t fired;
+                fired.splice(fired.end(), due, due.begin());
+                --size_;
+                expire(std::move(fired.front().value));
+            }
+        }
+
+    private:
+        uint64_t now_ = 0;
+        size_t size_ = 0;
+        std::array<std::array<slot_t, slots>, levels> wheels_;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef NET_BENCH_ASYNC_HPP
+#define NET_BENCH_ASYNC_HPP
+
+#include <atomic>
+#include <net.hpp>
+
+struct stats
+{
+    std::atomic<bool> stop = false;
+    std::atomic<size_t> messages = 0;
+};
+
+// send depth copies of one fixed size message to an echo server, wait for all of
+// them to come back and repeat until stats.stop is set
+class session : public std::enable_shared_from_this<session>
+{
+    public:
+        session(net::io_context& ioc, stats& stats, size_t size, size_t depth) :
+        socket_(ioc), stats_(stats)
+        {
+            carrier_.message()->set_message(std::string(size, 'x'));
+            carrier_.header().set_seq(8080);
+            carrier_.pack(request_);
+            for (size_t i = 0; i < depth; ++i)
+                requests_.insert(requests_.end(), { net::buffer(request_.header()), net::buffer(request_.payload().data(), request_.payload().size()) });
+        }
+
+        std::shared_ptr<session> shared_this()
+        {
+            return shared_from_this();
+        }
+
+        void run(const results_t& results)
+        {
+            net::async_connect(socket_, results,
+            [self = shared_this()](error_code_t ec, const endpoint_t&)
+            {
+                self->on_connect(ec);
+            });
+        }
+
+        void on_connect(error_code_t ec)
+        {
+            if (ec)
+                return fail(ec, "connect");
+
+            do_write();
+        }
+
+        void do_write()
+        {
+            net::async_write(socket_, requests_,
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                self->on_write(ec, bytes_transferred);
+            });
+        }
+
+        void on_write(error_code_t ec, size_t bytes_transferred)
+        {
+            if (ec)
+                return fail(ec, "write");
+
+            outstanding_ = requests_.size() / 2;
+            do_read();
+        }
+
+        void do_read()
+        {
+            auto [data, size] = decoder_.prepare();
+            if (! data)
+                return on_read(std::make_error_code(std::errc::message_size), 0);
+
+            socket_.async_read_some(net::buffer(data, size),
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                self->on_read(ec, bytes_transferred);
+            });
+        }
+
+        void on_read(error_code_t ec, size_t bytes_transferred)
+        {
+            if (ec)
+                return fail(ec, "read");
+
+            decoder_.commit(bytes_transferred);
+            size_t messages = 0;
+            while (decoder_.next())
+                ++messages;
+            decoder_.consume();
+
+            outstanding_ -= messages;
+            stats_.messages.fetch_add(messages, std::memory_order_relaxed);
+            if (outstanding_)
+                return do_read();
+
+            if (stats_.stop.load(std::memory_order_relaxed))
+                return do_close();
+
+            do_write();
+        }
+
+        void do_close()
+        {
+            error_code_t ec;
+            socket_.shutdown(net::socket_base::shutdown_both, ec);
+            socket_.close(ec);
+        }
+
+    private:
+        socket_t socket_;
+        stats& stats_;
+        frame request_;
+        decoder decoder_;
+        carrier_t carrier_;
+        size_t outstanding_ = 0;
+        std::vector<net::const_buffer> requests_;
+};
+
+#endif
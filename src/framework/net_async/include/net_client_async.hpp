@@ -45,9 +45,9 @@ class session : public std::enable_shared_from_this<session>
 
         void do_write()
         {
-            auto header = carrier_.header();
-            header->set_seq(8080);
-            header->set_service(srv_);
+            auto& header = carrier_.header();
+            header.set_seq(8080);
+            header.set_service(srv_);
             carrier_.pack(buffer_);
 
             net::async_write(socket_, net::buffer(buffer_),
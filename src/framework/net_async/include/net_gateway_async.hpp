@@ -1,23 +1,29 @@
 #ifndef NET_GATEWAY_ASYNC_HPP
 #define NET_GATEWAY_ASYNC_HPP
 
+#include <deque>
+#include <atomic>
+#include <chrono>
 #include <net.hpp>
+#include <outbox.hpp>
+#include <heartbeat.hpp>
+#include <inflight.hpp>
 #include <load_config.hpp>
 
 template <typename T>
-class request : public std::enable_shared_from_this<request<T>>
+class request : public keepalive, public std::enable_shared_from_this<request<T>>
 {
     public:
         request(T& g, socket_t socket) : gw(g),
         socket_(std::move(socket)), strand_(socket_.get_executor())
         {
         }
-        
-        socket_t& get()
+
+        ~request()
         {
-            return socket_;
+            gw.beat().forget(*this);
         }
-    
+        
         std::shared_ptr<request<T>> shared_this()
         {
             return this->shared_from_this();
@@ -25,53 +31,133 @@ class request : public std::enable_shared_from_this<request<T>>
     
         void run()
         {
-            do_read_header();
+            gw.beat().watch(*this);
+            do_read();
+        }
+
+        void ping()
+        {
+            net::post(strand_,
+            [self = shared_this()]
+            {
+                self->send(mode_type::ping);
+            });
+        }
+
+        void expire()
+        {
+            net::post(strand_,
+            [self = shared_this()]
+            {
+                self->do_close();
+            });
+        }
+
+        std::shared_ptr<keepalive> ref()
+        {
+            return this->weak_from_this().lock();
+        }
+
+        void deliver(frame frame_)
+        {
+            net::post(strand_,
+            [self = shared_this(), frame_ = std::move(frame_)]() mutable
+            {
+                self->on_deliver(std::move(frame_));
+            });
         }
     
-        void do_read_header()
+        void do_read()
         {
-            buffer_.resize(header_size());
-            net::async_read(socket_, net::buffer(buffer_), net::bind_executor(strand_,
+            if (auto missing = decoder_.spill(frame_))
+                return do_read_frame(missing.value());
+
+            auto [data, size] = decoder_.prepare();
+            if (! data)
+                return on_read(std::make_error_code(std::errc::message_size), 0);
+
+            socket_.async_read_some(net::buffer(data, size), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
-                self->on_read_header(ec, bytes_transferred);
+                self->on_read(ec, bytes_transferred);
             }));
         }
-    
-        void on_read_header(error_code_t ec, size_t bytes_transferred)
+
+        void on_read(error_code_t ec, size_t bytes_transferred)
         {
-            if (ec == net::error::eof)
+            if (ec)
                 return;
 
-            do_read_message();
+            gw.beat().touch(*this);
+            decoder_.commit(bytes_transferred);
+            while (auto view = decoder_.next())
+            {
+                // the gateway answers a client's ping itself
+                auto mode = static_cast<mode_type>(view->header.mode());
+                if (mode == mode_type::ping)
+                    send(mode_type::pong);
+                if (mode == mode_type::ping || mode == mode_type::pong)
+                    continue;
+
+                carrier_.set_header(view->header);
+                frame_.assign(view->data, view->size);
+                route();
+            }
+            decoder_.consume();
+            do_read();
         }
 
-        void do_read_message()
+        void do_read_frame(size_t missing)
         {
-            size_t size = carrier_.decode_header(buffer_);
-            net::async_read(socket_, net::buffer(std::addressof(buffer_[header_size()]), size), net::bind_executor(strand_,
+            auto& payload = frame_.payload();
+            net::async_read(socket_, net::buffer(payload.data() + payload.size() - missing, missing), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
-                self->on_read_message(ec, bytes_transferred);
+                self->on_read_frame(ec, bytes_transferred);
             }));
         }
 
-        void on_read_message(error_code_t ec, size_t bytes_transferred)
+        void on_read_frame(error_code_t ec, size_t bytes_transferred)
         {
-            if (ec == net::error::eof)
+            if (ec)
                 return;
 
-            do_write();
+            gw.beat().touch(*this);
+            carrier_.decode_header(frame_);
+            route();
+            do_read();
         }
 
-        void do_write()
+        void send(mode_type mode)
         {
-            auto opt = gw.parse(carrier_, buffer_, shared_this());
-            if (! opt)
-                return;
+            frame control;
+            control.header() = control_header(mode);
+            on_deliver(std::move(control));
+        }
+
+        void do_close()
+        {
+            error_code_t ec;
+            socket_.shutdown(net::socket_base::shutdown_both, ec);
+            socket_.close(ec);
+        }
+
+        void route()
+        {
+            auto opt = gw.parse(carrier_, frame_, shared_this());
+            if (opt)
+                opt.value()->deliver(std::move(frame_));
+        }
+
+        void on_deliver(frame frame_)
+        {
+            if (frames_.push(std::move(frame_)))
+                do_write();
+        }
 
-            carrier_.pack(buffer_);
-            net::async_write(opt.value()->get(), net::buffer(buffer_), net::bind_executor(strand_,
+        void do_write()
+        {
+            net::async_write(socket_, frames_.flush(), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
                 self->on_write(ec, bytes_transferred);
@@ -83,50 +169,82 @@ class request : public std::enable_shared_from_this<request<T>>
             if (ec)
                 return fail(ec, "write");
 
-            do_read_header();
+            if (frames_.written())
+                do_write();
         }
 
     private:
         T& gw;
         socket_t socket_;
         strand_t strand_;
-        buffer_t buffer_;
+        frame frame_;
+        decoder decoder_;
         carrier_t carrier_;
+        outbox<frame> frames_;
 };
    
+// one pooled upstream connection; when it drops it is closed() to select() and
+// reconnects on its own, backing off from min_backoff to max_backoff
 template <typename T>
 class response : public std::enable_shared_from_this<response<T>>
 {
     public:
+        static constexpr std::chrono::milliseconds min_backoff{100};
+        static constexpr std::chrono::milliseconds max_backoff{5000};
+
         explicit response(T& g, net::io_context& ioc, uint32_t service) : gw(g),
-        resolver_(ioc), socket_(ioc), strand_(socket_.get_executor()), service_(service)
+        resolver_(ioc), socket_(ioc), strand_(socket_.get_executor()), timer_(ioc), service_(service)
         {
         }
     
-        socket_t& get()
-        {
-            return socket_;
-        }
-    
         std::shared_ptr<response<T>> shared_this()
         {
             return this->shared_from_this();
         }
+
+        size_t outstanding() const
+        {
+            return outstanding_;
+        }
+
+        bool closed() const
+        {
+            return closed_;
+        }
+
+        void complete()
+        {
+            --outstanding_;
+        }
     
         void run(const std::string& host, const std::string& port)
         {
             host_ = host;
+            port_ = port;
             resolver_.async_resolve(host, port, net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, results_t results)
             {
                 self->on_resolve(ec, results);
             }));
         }
+
+        void deliver(frame frame_)
+        {
+            ++outstanding_;
+            net::post(strand_,
+            [self = shared_this(), frame_ = std::move(frame_)]() mutable
+            {
+                self->on_deliver(std::move(frame_));
+            });
+        }
     
         void on_resolve(error_code_t ec, results_t results)
         {
             if (ec)
-                return fail(ec, "resolve");
+            {
+                fail(ec, "resolve");
+                return do_reconnect();
+            }
 
             net::async_connect(socket_, results,
             net::bind_executor(strand_, std::bind(&response::on_connect, shared_this(), std::placeholders::_1)));
@@ -135,73 +253,143 @@ class response : public std::enable_shared_from_this<response<T>>
         void on_connect(error_code_t ec)
         {
             if (ec)
-                return fail(ec, "connect");
+            {
+                fail(ec, "connect");
+                return do_reconnect();
+            }
 
-            do_read_header();
+            connected_ = true;
+            closed_ = false;
+            backoff_ = min_backoff;
+            if (! writing_ && ! frames_.empty())
+                do_write();
+            do_read();
         }
 
-        void do_read_header()
+        // requests in flight on the dropped connection are left to time out; the
+        // ones queued since go out once it is back
+        void do_reconnect()
         {
-            buffer_.resize(header_size());
-            net::async_read(socket_, net::buffer(buffer_), net::bind_executor(strand_,
+            closed_ = true;
+            connected_ = false;
+            error_code_t ec;
+            socket_.close(ec);
+            decoder_ = decoder();
+
+            timer_.expires_after(backoff_);
+            backoff_ = std::min(backoff_ * 2, max_backoff);
+            timer_.async_wait(net::bind_executor(strand_,
+            [self = shared_this()](error_code_t ec)
+            {
+                if (! ec)
+                    self->run(self->host_, self->port_);
+            }));
+        }
+
+        void do_read()
+        {
+            if (auto missing = decoder_.spill(frame_))
+                return do_read_frame(missing.value());
+
+            auto [data, size] = decoder_.prepare();
+            if (! data)
+                return on_read(std::make_error_code(std::errc::message_size), 0);
+
+            socket_.async_read_some(net::buffer(data, size), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
-                self->on_read_header(ec, bytes_transferred);
+                self->on_read(ec, bytes_transferred);
             }));
         }
-    
-        void on_read_header(error_code_t ec, size_t bytes_transferred)
+
+        void on_read(error_code_t ec, size_t bytes_transferred)
         {
-            if (ec == net::error::eof)
+            if (ec)
+                return do_reconnect();
+
+            decoder_.commit(bytes_transferred);
+            while (auto view = decoder_.next())
             {
-                gw.close(service_);
-                return;
-            }
+                // the upstream server checks on an idle pool connection
+                if (static_cast<mode_type>(view->header.mode()) == mode_type::ping)
+                {
+                    frame pong;
+                    pong.header() = control_header(mode_type::pong);
+                    on_deliver(std::move(pong));
+                    continue;
+                }
 
-            do_read_message();
+                carrier_.set_header(view->header);
+                frame_.assign(view->data, view->size);
+                route();
+            }
+            decoder_.consume();
+            do_read();
         }
 
-        void do_read_message()
+        void do_read_frame(size_t missing)
         {
-            size_t size = carrier_.decode_header(buffer_);
-            net::async_read(socket_, net::buffer(std::addressof(buffer_[header_size()]), size), net::bind_executor(strand_,
+            auto& payload = frame_.payload();
+            net::async_read(socket_, net::buffer(payload.data() + payload.size() - missing, missing), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
-                self->on_read_message(ec, bytes_transferred);
+                self->on_read_frame(ec, bytes_transferred);
             }));
         }
-    
-        void on_read_message(error_code_t ec, size_t bytes_transferred)
+
+        void on_read_frame(error_code_t ec, size_t bytes_transferred)
         {
-            if (ec == net::error::eof)
+            if (ec)
+                return do_reconnect();
+
+            carrier_.decode_header(frame_);
+            route();
+            do_read();
+        }
+
+        void route()
+        {
+            auto opt = gw.parse(carrier_, frame_);
+            if (opt)
             {
-                gw.close(service_);
-                return;
+                complete();
+                opt.value()->deliver(std::move(frame_));
             }
+        }
 
-            do_write();
+        void on_deliver(frame frame_)
+        {
+            if (frames_.push(std::move(frame_)) && connected_)
+                do_write();
         }
 
         void do_write()
         {
-            auto opt = gw.parse(carrier_, buffer_);
-            if (! opt)
-                return;
-
-            carrier_.pack(buffer_);
-            net::async_write(opt.value()->get(), net::buffer(buffer_), net::bind_executor(strand_,
+            writing_ = true;
+            net::async_write(socket_, frames_.flush(), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
                 self->on_write(ec, bytes_transferred);
             }));
         }
     
+        // a failed write only closes the socket, the pending read then reconnects
         void on_write(error_code_t ec, size_t bytes_transferred)
         {
+            writing_ = false;
+            bool more = frames_.written();
             if (ec)
-                return fail(ec, "write");
+            {
+                if (ec != std::errc::operation_canceled)
+                    fail(ec, "write");
+                closed_ = true;
+                error_code_t ignored;
+                socket_.close(ignored);
+                return;
+            }
 
-            do_read_header();
+            if (more && connected_)
+                do_write();
         }
 
     private:
@@ -209,10 +397,19 @@ class response : public std::enable_shared_from_this<response<T>>
         tcp::resolver resolver_;
         socket_t socket_;
         strand_t strand_;
-        buffer_t buffer_;
+        net::steady_timer timer_;
+        frame frame_;
+        decoder decoder_;
         carrier_t carrier_;
         std::string host_;
+        std::string port_;
         uint32_t service_;
+        bool connected_ = false;
+        bool writing_ = false;
+        std::chrono::milliseconds backoff_ = min_backoff;
+        outbox<frame> frames_;
+        std::atomic<bool> closed_ = false;
+        std::atomic<size_t> outstanding_ = 0;
 };
 
 class listener : public std::enable_shared_from_this<listener>
@@ -220,9 +417,23 @@ class listener : public std::enable_shared_from_this<listener>
     public:
         using request_t = std::shared_ptr<request<listener>>;
         using response_t = std::shared_ptr<response<listener>>;
+        using pool_t = std::vector<response_t>;
+        using plugin_t = std::function<bool(carrier_t&)>;
+
+        // what a timeout reply needs to look like the response it stands in for
+        struct pending_t
+        {
+            request_t client;
+            response_t upstream;
+            uint16_t service;
+            char mark[2];
+        };
+
+        static constexpr std::chrono::milliseconds tick{100};
     
-        listener(net::io_context& ioc_, endpoint_t endpoint) :
-        ioc(ioc_), acceptor_(ioc)
+        listener(net::io_context& ioc_, endpoint_t endpoint, size_t pool, std::chrono::milliseconds timeout, const heartbeat_options& options) :
+        ioc(ioc_), acceptor_(ioc), timer_(ioc), pool_(pool), timeout_(std::max<uint64_t>(timeout / tick, 1)),
+        start_(std::chrono::steady_clock::now()), beat_(ioc, options)
         {
             error_code_t ec;
             acceptor_.open(endpoint.protocol(), ec);
@@ -255,40 +466,65 @@ class listener : public std::enable_shared_from_this<listener>
             }
         }
     
-        uint32_t next()
+        // plugins and pools are read without locking, so they are fixed once run() is called
+        void route(uint32_t service, plugin_t plugin)
         {
-            return sequence++;
+            plugins.insert_or_assign(service, std::move(plugin));
         }
-    
-        void close(uint32_t service)
+
+        heartbeat& beat()
         {
-            responses.erase(service);
+            return beat_;
         }
 
-        std::optional<request_t> parse(carrier_t& carrier_, const buffer_t& buffer_)
+        std::optional<request_t> parse(carrier_t& carrier_, frame& frame_)
         {
-            auto header = carrier_.header();
-            carrier_.decode_message(buffer_);
-            auto it = requests.find(header->seq());
-            if (it == requests.end())
+            auto entry = requests.take(carrier_.header().seq());
+            if (! entry)
                 return {};
-            auto ptr = it->second.second;
-            header->set_seq(it->second.first);
-            requests.erase(it);
-            return ptr;
+            protocol::patch_seq(frame_.header().data(), entry->first);
+            return entry->second.client;
         }
     
-        std::optional<response_t> parse(carrier_t& carrier_, const buffer_t& buffer_, request_t ptr)
+        std::optional<response_t> parse(carrier_t& carrier_, frame& frame_, request_t ptr)
         {
-            auto header = carrier_.header();
-            carrier_.decode_message(buffer_);
-            auto it = responses.find(header->service());
-            if (it == responses.end())
+            auto& header = carrier_.header();
+            auto plugin = plugins.find(header.service());
+            if (plugin != plugins.end())
+            {
+                if (! carrier_.decode_message(frame_) || ! plugin->second(carrier_))
+                    return {};
+            }
+            auto it = responses.find(header.service());
+            auto least = it == responses.end() ? std::nullopt : select(it->second);
+            if (! least)
+            {
+                ptr->deliver(error_reply(header.mark(), header.service(), header.seq(), error_type::unavailable));
                 return {};
-            uint32_t seq = next();
-            requests.try_emplace(seq, header->seq(), ptr);
-            header->set_seq(seq);
-            return it->second;
+            }
+            auto mark = header.mark();
+            uint32_t seq = requests.insert(header.seq(), pending_t{ptr, least.value(), header.service(), {mark[0], mark[1]}}, timeout_);
+            if (plugin == plugins.end())
+                protocol::patch_seq(frame_.header().data(), seq);
+            else
+            {
+                header.set_seq(seq);
+                carrier_.pack(frame_);
+            }
+            return least;
+        }
+
+        std::optional<response_t> select(const pool_t& pool)
+        {
+            const response_t* least = nullptr;
+            for (auto& resp : pool)
+            {
+                if (! resp->closed() && (! least || resp->outstanding() < (*least)->outstanding()))
+                    least = &resp;
+            }
+            if (! least)
+                return {};
+            return *least;
         }
 
         void run(const service_t& services)
@@ -297,12 +533,67 @@ class listener : public std::enable_shared_from_this<listener>
                 return;
             for (auto& [service, endpoint] : services)
             {
-                auto resp = std::make_shared<response<listener>>(*this, ioc, service);
-                responses.try_emplace(service, resp);
-                resp->run(endpoint.first, endpoint.second);
+                auto& pool = responses[service];
+                for (size_t i = 0; i != pool_; ++i)
+                {
+                    auto resp = std::make_shared<response<listener>>(*this, ioc, service);
+                    pool.push_back(resp);
+                    resp->run(endpoint.first, endpoint.second);
+                }
             }
+            beat_.run();
+            do_tick();
             do_accept();
         }
+
+        size_t expired() const
+        {
+            return expired_;
+        }
+
+        uint64_t ticks() const
+        {
+            return (std::chrono::steady_clock::now() - start_) / tick;
+        }
+
+        void do_tick()
+        {
+            timer_.expires_after(tick);
+            timer_.async_wait(
+            [self = shared_from_this()](error_code_t ec)
+            {
+                self->on_tick(ec);
+            });
+        }
+
+        void on_tick(error_code_t ec)
+        {
+            if (ec)
+                return fail(ec, "timer");
+
+            expired_ += requests.expire(ticks(),
+            [](auto& entry)
+            {
+                auto& pending = entry.second;
+                pending.upstream->complete();
+                pending.client->deliver(error_reply(pending.mark, pending.service, entry.first, error_type::timeout));
+            });
+            do_tick();
+        }
+
+        // a response with no payload that fails the client's request itself
+        static frame error_reply(const char* mark, uint16_t service, uint32_t seq, error_type error)
+        {
+            protocol header{};
+            header.set_mark(mark[0], mark[1]);
+            header.set_mode(static_cast<uint8_t>(mode_type::response));
+            header.set_service(service);
+            header.set_seq(seq);
+            header.set_error(static_cast<uint16_t>(error));
+            frame frame_;
+            header.encode(frame_.header().data());
+            return frame_;
+        }
     
         void do_accept()
         {
@@ -323,11 +614,17 @@ class listener : public std::enable_shared_from_this<listener>
         }
 
     private:
-        uint32_t sequence = 0;
         net::io_context& ioc;
         tcp::acceptor acceptor_;
-        hashmap_t<response_t> responses;
-        hashmap_t<std::pair<uint32_t, request_t>> requests;
+        net::steady_timer timer_;
+        size_t pool_;
+        uint64_t timeout_;
+        std::atomic<size_t> expired_ = 0;
+        std::chrono::steady_clock::time_point start_;
+        heartbeat beat_;
+        hashmap_t<plugin_t> plugins;
+        hashmap_t<pool_t> responses;
+        inflight<pending_t> requests;
 };
     
 #endif
@@ -0,0 +1,82 @@
+#ifndef NET_HEADER_BENCH_HPP
+#define NET_HEADER_BENCH_HPP
+
+#include <memory>
+#include <carrier.hpp>
+
+// the header codec carrier used before the header became a fixed-layout struct:
+// a byte at a time, into a protocol held behind a shared_ptr
+class legacy_codec
+{
+    public:
+        using protocol_t = std::shared_ptr<protocol>;
+
+        legacy_codec() : header_(std::make_shared<protocol>())
+        {
+        }
+
+        protocol_t header()
+        {
+            return header_;
+        }
+
+        length_t decode_header(const byte_t* buffer)
+        {
+            size_t i = 0;
+            auto mark = header_->mark();
+            mark[0] = std::to_integer<char>(buffer[i++]);
+            mark[1] = std::to_integer<char>(buffer[i++]);
+            header_->set_version(std::to_integer<uint8_t>(buffer[i++]));
+            header_->set_crypt(std::to_integer<uint8_t>(buffer[i++]));
+            length_t bytes_transferred = to_size<length_t>(buffer, i);
+            header_->set_length(bytes_transferred);
+            header_->set_mode(std::to_integer<uint8_t>(buffer[i++]));
+            header_->set_type(std::to_integer<uint8_t>(buffer[i++]));
+            header_->set_service(to_size<uint16_t>(buffer, i));
+            header_->set_agent(to_size<uint16_t>(buffer, i));
+            header_->set_error(to_size<uint16_t>(buffer, i));
+            header_->set_seq(to_size<uint32_t>(buffer, i));
+            header_->set_res(to_size<uint32_t>(buffer, i));
+            return bytes_transferred;
+        }
+
+        void encode_header(byte_t* buffer)
+        {
+            size_t i = 0;
+            auto mark = header_->mark();
+            buffer[i++] = static_cast<byte_t>(mark[0]);
+            buffer[i++] = static_cast<byte_t>(mark[1]);
+            buffer[i++] = static_cast<byte_t>(header_->version());
+            buffer[i++] = static_cast<byte_t>(header_->crypt());
+            to_byte<length_t>(buffer, i, header_->length());
+            buffer[i++] = static_cast<byte_t>(header_->mode());
+            buffer[i++] = static_cast<byte_t>(header_->type());
+            to_byte<uint16_t>(buffer, i, header_->service());
+            to_byte<uint16_t>(buffer, i, header_->agent());
+            to_byte<uint16_t>(buffer, i, header_->error());
+            to_byte<length_t>(buffer, i, header_->seq());
+            to_byte<length_t>(buffer, i, header_->res());
+        }
+
+    private:
+        template <typename T>
+        T to_size(const byte_t* buffer, size_t& i)
+        {
+            T size = 0;
+            for (size_t j = 0; j != sizeof(T); ++j)
+                 size = (size << 8) + (std::to_integer<T>(buffer[i++]) & 0xFF);
+            return size;
+        }
+
+        template <typename T>
+        void to_byte(byte_t* buffer, size_t& i, T value)
+        {
+            for (size_t j = 0; j != sizeof(T); ++j)
+                 buffer[i++] = static_cast<byte_t>((value >> ((sizeof(T) - j - 1) * 8)) & 0xFF);
+        }
+
+    private:
+        protocol_t header_;
+};
+
+#endif
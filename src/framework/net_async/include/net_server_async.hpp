@@ -2,15 +2,22 @@
 #define NET_SERVER_ASYNC_HPP
 
 #include <net.hpp>
+#include <runtime.hpp>
+#include <heartbeat.hpp>
  
-class session : public std::enable_shared_from_this<session>
+class session : public keepalive, public std::enable_shared_from_this<session>
 {
     public:
-        session(socket_t socket) :
-        socket_(std::move(socket)), strand_(socket_.get_executor())
+        session(socket_t socket, heartbeat& beat) :
+        socket_(std::move(socket)), strand_(socket_.get_executor()), beat_(beat)
         {
         }
 
+        ~session()
+        {
+            beat_.forget(*this);
+        }
+
         std::shared_ptr<session> shared_this()
         {
             return shared_from_this();
@@ -18,48 +25,80 @@ class session : public std::enable_shared_from_this<session>
 
         void run()
         {
-            do_read_header();
+            beat_.watch(*this);
+            do_read();
         }
-    
-        void do_read_header()
+
+        void ping()
         {
-            buffer_.resize(header_size());
-            net::async_read(socket_, net::buffer(buffer_), net::bind_executor(strand_,
-            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            net::post(strand_,
+            [self = shared_this()]
             {
-                self->on_read_header(ec, bytes_transferred);
-            }));
+                self->ping_ = true;
+                self->do_ping();
+            });
         }
 
-        void on_read_header(error_code_t ec, size_t bytes_transferred)
+        void expire()
         {
-            if (ec == net::error::eof)
-                return;
+            net::post(strand_,
+            [self = shared_this()]
+            {
+                self->do_close();
+            });
+        }
 
-            do_read_message();
+        std::shared_ptr<keepalive> ref()
+        {
+            return weak_from_this().lock();
         }
 
-        void do_read_message()
+        void do_read()
         {
-            size_t size = carrier_.decode_header(buffer_);
-            net::async_read(socket_, net::buffer(std::addressof(buffer_[header_size()]), size), net::bind_executor(strand_,
+            if (auto missing = decoder_.spill(frame_))
+                return do_read_frame(missing.value());
+
+            auto [data, size] = decoder_.prepare();
+            if (! data)
+                return on_read(std::make_error_code(std::errc::message_size), 0);
+
+            socket_.async_read_some(net::buffer(data, size), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
-                self->on_read_message(ec, bytes_transferred);
+                self->on_read(ec, bytes_transferred);
             }));
         }
-        
-        void on_read_message(error_code_t ec, size_t bytes_transferred)
+
+        void on_read(error_code_t ec, size_t bytes_transferred)
         {
-            if (ec == net::error::eof)
+            if (ec)
                 return;
 
-            do_write();
+            // a ping is answered by echoing it as a pong, a pong is echoed like any
+            // other frame and ignored by the peer
+            beat_.touch(*this);
+            decoder_.commit(bytes_transferred);
+            while (auto view = decoder_.next())
+                if (static_cast<mode_type>(view->header.mode()) == mode_type::ping)
+                    protocol::patch_mode(view->data, mode_type::pong);
+
+            if (decoder_.ready())
+                do_write();
+            else
+                do_read();
         }
 
+        // every complete frame is echoed back as is, straight out of the read buffer
         void do_write()
         {
-            net::async_write(socket_, net::buffer(buffer_), net::bind_executor(strand_,
+            if (writing_)
+            {
+                deferred_ = &session::do_write;
+                return;
+            }
+
+            writing_ = true;
+            net::async_write(socket_, net::buffer(decoder_.data(), decoder_.ready()), net::bind_executor(strand_,
             [self = shared_this()](error_code_t ec, size_t bytes_transferred)
             {
                 self->on_write(ec, bytes_transferred);
@@ -68,23 +107,111 @@ class session : public std::enable_shared_from_this<session>
     
         void on_write(error_code_t ec, size_t bytes_transferred)
         {
+            writing_ = false;
             if (ec)
                 return fail(ec, "write");
 
-            do_read_header();
+            decoder_.consume();
+            do_ping();
+            do_read();
+        }
+
+        void do_read_frame(size_t missing)
+        {
+            auto& payload = frame_.payload();
+            net::async_read(socket_, net::buffer(payload.data() + payload.size() - missing, missing), net::bind_executor(strand_,
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                self->on_read_frame(ec, bytes_transferred);
+            }));
+        }
+
+        void on_read_frame(error_code_t ec, size_t bytes_transferred)
+        {
+            if (ec)
+                return;
+
+            beat_.touch(*this);
+            do_write_frame();
+        }
+
+        void do_write_frame()
+        {
+            if (writing_)
+            {
+                deferred_ = &session::do_write_frame;
+                return;
+            }
+
+            writing_ = true;
+            net::async_write(socket_, buffers(frame_), net::bind_executor(strand_,
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                self->on_write_frame(ec, bytes_transferred);
+            }));
+        }
+
+        void on_write_frame(error_code_t ec, size_t bytes_transferred)
+        {
+            writing_ = false;
+            if (ec)
+                return fail(ec, "write");
+
+            frame_.payload().release();
+            do_ping();
+            do_read();
+        }
+
+        // a ping never interleaves with an echo: it waits for the write in flight,
+        // and an echo that comes up meanwhile waits for the ping
+        void do_ping()
+        {
+            if (! ping_ || writing_)
+                return;
+
+            static const auto ping = control_header(mode_type::ping);
+            ping_ = false;
+            writing_ = true;
+            net::async_write(socket_, net::buffer(ping), net::bind_executor(strand_,
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                self->on_ping(ec, bytes_transferred);
+            }));
+        }
+
+        void on_ping(error_code_t ec, size_t bytes_transferred)
+        {
+            writing_ = false;
+            if (ec)
+                return fail(ec, "write");
+
+            if (auto next = std::exchange(deferred_, nullptr))
+                (this->*next)();
+        }
+
+        void do_close()
+        {
+            error_code_t ec;
+            socket_.shutdown(net::socket_base::shutdown_both, ec);
+            socket_.close(ec);
         }
 
     private:
         socket_t socket_;
         strand_t strand_;
-        buffer_t buffer_;
-        carrier_t carrier_;
+        heartbeat& beat_;
+        frame frame_;
+        decoder decoder_;
+        bool writing_ = false;
+        bool ping_ = false;
+        void (session::*deferred_)() = nullptr;
 };
 
 class listener : public std::enable_shared_from_this<listener>
 {
     public:
-        listener(net::io_context& ioc, endpoint_t endpoint) : acceptor_(ioc)
+        listener(net::io_context& ioc, endpoint_t endpoint, heartbeat& beat, bool reuseport = false) :
+        acceptor_(ioc), beat_(beat)
         {
             error_code_t ec;
             acceptor_.open(endpoint.protocol(), ec);
@@ -102,6 +229,14 @@ class listener : public std::enable_shared_from_this<listener>
                 return;
             }
 
+            if (reuseport)
+                acceptor_.set_option(reuse_port(true), ec);
+            if (ec)
+            {
+                fail(ec, "set_option");
+                return;
+            }
+
             acceptor_.bind(endpoint, ec);
             if (ec)
             {
@@ -138,12 +273,13 @@ class listener : public std::enable_shared_from_this<listener>
             if (ec)
                 fail(ec, "accept");
             else
-                std::make_shared<session>(std::move(socket))->run();
+                std::make_shared<session>(std::move(socket), beat_)->run();
             do_accept();
         }
 
     private:
         tcp::acceptor acceptor_;
+        heartbeat& beat_;
 };
 
 #endif
@@ -0,0 +1,119 @@
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <inflight.hpp>
+
+// every insert carries a unique token and a seq derived from it; each token has
+// to come back exactly once, from take() or from expire(), with its own seq
+inline uint32_t seq_of(uint32_t token)
+{
+    return token * 2654435761u;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 3)
+    {
+        std::cerr << "Usage:   " << argv[0] << " [<threads>] [<inserts per thread>]\n"
+                  << "Example: " << argv[0] << " 8 1000000\n";
+        return 1;
+    }
+
+    auto const threads = static_cast<size_t>(argc >= 2 ? std::stoul(argv[1]) : std::thread::hardware_concurrency());
+    auto const inserts = static_cast<size_t>(argc == 3 ? std::stoul(argv[2]) : 1000000);
+    auto const total = threads * inserts;
+
+    inflight<uint32_t> table;
+    std::vector<std::atomic<uint8_t>> seen(total);
+    std::vector<std::vector<uint32_t>> ids(threads);
+    std::vector<std::atomic<uint32_t>> recent(4096);
+    std::atomic<uint64_t> now = 0;
+    std::atomic<size_t> running = threads;
+    std::atomic<size_t> taken = 0;
+    std::atomic<size_t> expired = 0;
+    std::atomic<size_t> wrong = 0;
+
+    auto deliver = [&](const std::pair<uint32_t, uint32_t>& entry)
+    {
+        if (entry.second >= total || entry.first != seq_of(entry.second))
+            ++wrong;
+        else
+            seen[entry.second].fetch_add(1, std::memory_order_relaxed);
+    };
+
+    // workers insert and take concurrently; ids go through a shared ring so
+    // threads race each other, and the expirer, for the same entry
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]
+        {
+            std::mt19937 random(t);
+            ids[t].reserve(inserts);
+            for (size_t i = 0; i < inserts; ++i)
+            {
+                uint32_t token = t * inserts + i;
+                uint32_t id = table.insert(seq_of(token), token, 1 + random() % 8);
+                ids[t].push_back(id);
+                recent[random() % recent.size()].store(id, std::memory_order_relaxed);
+
+                if (random() % 4 != 0)
+                {
+                    if (auto entry = table.take(recent[random() % recent.size()].load(std::memory_order_relaxed)))
+                    {
+                        deliver(*entry);
+                        ++taken;
+                    }
+                }
+            }
+            --running;
+        });
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    std::thread expirer([&]
+    {
+        while (running)
+        {
+            expired += table.expire(++now, deliver);
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    });
+
+    for (auto& worker : workers)
+        worker.join();
+    expirer.join();
+    expired += table.expire(now + 64, deliver);
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t lost = 0;
+    size_t duplicated = 0;
+    for (auto& count : seen)
+    {
+        if (count == 0)
+            ++lost;
+        else if (count > 1)
+            ++duplicated;
+    }
+
+    std::vector<uint32_t> all;
+    all.reserve(total);
+    for (auto& v : ids)
+        all.insert(all.end(), v.begin(), v.end());
+    std::sort(all.begin(), all.end());
+    size_t reused = all.end() - std::unique(all.begin(), all.end());
+
+    std::cout << threads << " threads, " << total << " inserts in " << elapsed << "s, "
+              << static_cast<size_t>(total / elapsed) << " inserts/sec\n"
+              << "taken " << taken << ", expired " << expired << ", left " << table.size() << "\n"
+              << "lost " << lost << ", duplicated " << duplicated << ", wrong seq " << wrong
+              << ", reused ids " << reused << "\n";
+
+    bool ok = lost == 0 && duplicated == 0 && wrong == 0 && reused == 0 && table.size() == 0 && taken + expired == total;
+    std::cout << (ok ? "ok" : "FAILED") << "\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+#include <net_bench_async.hpp>
+
+int main(int argc, char* argv[])
+{
+    if (argc < 6 || argc > 8)
+    {
+        std::cerr << "Usage:   " << argv[0] << " <host> <port> <connections> <size> <seconds> [<threads>] [<depth>]\n"
+                  << "Example: " << argv[0] << " 127.0.0.1 8080 256 64 10 4 16\n";
+        return 1;
+    }
+
+    auto const host = argv[1];
+    auto const port = argv[2];
+    auto const connections = static_cast<size_t>(std::stoul(argv[3]));
+    auto const size = static_cast<size_t>(std::stoul(argv[4]));
+    auto const seconds = std::chrono::seconds(std::stoul(argv[5]));
+    auto const threads = argc >= 7 ? std::stoi(argv[6]) : 1;
+    auto const depth = static_cast<size_t>(argc == 8 ? std::stoul(argv[7]) : 1);
+
+    net::io_context ioc{threads};
+    tcp::resolver resolver{ioc};
+    auto const results = resolver.resolve(host, port);
+
+    stats stats;
+    for (size_t i = 0; i < connections; ++i)
+        std::make_shared<session>(ioc, stats, size, depth)->run(results);
+
+    net::steady_timer timer{ioc, seconds};
+    auto const start = std::chrono::steady_clock::now();
+    timer.async_wait([&](error_code_t ec)
+    {
+        stats.stop = true;
+        auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        auto const messages = stats.messages.load();
+        std::cout << messages << " messages in " << elapsed << "s, "
+                  << static_cast<size_t>(messages / elapsed) << " msgs/sec\n";
+        pool::report(std::cout);
+    });
+
+    std::vector<std::thread> v;
+    v.reserve(threads - 1);
+
+    for(auto i = threads - 1; i > 0; --i)
+        v.emplace_back([&ioc]{ ioc.run(); });
+    ioc.run();
+
+    for (auto& t : v)
+        t.join();
+
+    return 0;
+}
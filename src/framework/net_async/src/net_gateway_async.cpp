@@ -1,20 +1,40 @@
+#include <unistd.h>
 #include <net_gateway_async.hpp>
     
 int main(int argc, char* argv[])
 {
-    if (argc != 4)
+    heartbeat_options options;
+
+    int opt;
+    bool usage = false;
+    while ((opt = getopt(argc, argv, "k:t:")) != -1)
+    {
+        if (opt == 'k')
+            options.idle = std::chrono::seconds(std::stoul(optarg));
+        else if (opt == 't')
+            options.timeout = std::chrono::seconds(std::stoul(optarg));
+        else
+            usage = true;
+    }
+
+    if (usage || argc - optind < 3 || argc - optind > 5)
     {
-        std::cerr << "Usage: " << argv[0] << " <host> <port> <conf>\n";
+        std::cerr << "Usage: " << argv[0] << " [-k <idle seconds before a ping, 0 off>] [-t <pong timeout seconds>]\n"
+                  << "       <host> <port> <conf> [<pool>] [<timeout ms>]\n";
         return 1;
     }
 
-    auto const host = net::ip::make_address(argv[1]);
-    auto const port = static_cast<unsigned short>(std::atoi(argv[2]));
+    auto const args = argv + optind;
+    auto const count = argc - optind;
+    auto const host = net::ip::make_address(args[0]);
+    auto const port = static_cast<unsigned short>(std::atoi(args[1]));
     auto const threads = static_cast<int>(std::thread::hardware_concurrency());
+    auto const pool = static_cast<size_t>(count > 3 ? std::atoi(args[3]) : 4);
+    auto const timeout = std::chrono::milliseconds(count > 4 ? std::atoi(args[4]) : 30000);
     
     net::io_context ioc{threads};
-    auto services = loadconfig(argv[3]);
-    std::make_shared<listener>(ioc, endpoint_t{host, port})->run(services);
+    auto services = loadconfig(args[2]);
+    std::make_shared<listener>(ioc, endpoint_t{host, port}, pool, timeout, options)->run(services);
 
     std::vector<std::thread> v;
     v.reserve(threads - 1);
@@ -0,0 +1,90 @@
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <net_header_bench.hpp>
+
+template <typename F>
+double measure(size_t headers, size_t passes, F&& f)
+{
+    auto const start = std::chrono::steady_clock::now();
+    for (size_t pass = 0; pass < passes; ++pass)
+        for (size_t i = 0; i < headers; ++i)
+             f(i);
+    auto const elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return elapsed / (headers * passes);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 3)
+    {
+        std::cerr << "Usage:   " << argv[0] << " [<headers>] [<passes>]\n"
+                  << "Example: " << argv[0] << " 4096 10000\n";
+        return 1;
+    }
+
+    auto const headers = static_cast<size_t>(argc >= 2 ? std::stoul(argv[1]) : 4096);
+    auto const passes = static_cast<size_t>(argc == 3 ? std::stoul(argv[2]) : 10000);
+
+    std::mt19937 random(8080);
+    std::vector<byte_t> wire(headers * header_size());
+    for (auto& b : wire)
+         b = static_cast<byte_t>(random());
+
+    legacy_codec legacy;
+    protocol header{};
+    std::vector<byte_t> legacy_out(wire.size());
+    std::vector<byte_t> out(wire.size());
+
+    // both codecs have to agree on every field and every byte before timing them
+    for (size_t i = 0; i < headers; ++i)
+    {
+        auto data = wire.data() + i * header_size();
+        legacy.decode_header(data);
+        header.decode(data);
+        if (std::memcmp(legacy.header().get(), &header, sizeof(protocol)) != 0)
+        {
+            std::cerr << "decode mismatch at header " << i << "\n";
+            return 1;
+        }
+        legacy.encode_header(legacy_out.data() + i * header_size());
+        header.encode(out.data() + i * header_size());
+    }
+    if (legacy_out != wire || out != wire)
+    {
+        std::cerr << "encode mismatch\n";
+        return 1;
+    }
+
+    uint64_t sink = 0;
+    auto const legacy_decode = measure(headers, passes, [&](size_t i)
+    {
+        sink += legacy.decode_header(wire.data() + i * header_size());
+    });
+    auto const decode = measure(headers, passes, [&](size_t i)
+    {
+        header.decode(wire.data() + i * header_size());
+        sink += header.length();
+    });
+    auto const legacy_encode = measure(headers, passes, [&](size_t i)
+    {
+        legacy.header()->set_seq(i);
+        legacy.encode_header(out.data() + i * header_size());
+    });
+    auto const encode = measure(headers, passes, [&](size_t i)
+    {
+        header.set_seq(i);
+        header.encode(out.data() + i * header_size());
+    });
+    for (auto b : out)
+         sink += std::to_integer<uint8_t>(b);
+
+    std::cout << headers << " headers x " << passes << " passes, ns/header\n"
+              << "decode_header  old " << legacy_decode << "  new " << decode << "\n"
+              << "encode_header  old " << legacy_encode << "  new " << encode << "\n"
+              << "(checksum " << sink << ")\n";
+
+    return 0;
+}
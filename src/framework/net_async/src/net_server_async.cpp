@@ -1,27 +1,51 @@
+#include <unistd.h>
 #include <net_server_async.hpp>
 
 int main(int argc, char* argv[])
 {
-    if (argc != 3)
+    heartbeat_options options;
+
+    int opt;
+    bool usage = false;
+    while ((opt = getopt(argc, argv, "k:t:")) != -1)
     {
-        std::cerr << "Usage:   " << argv[0] << " <host> <port>\n"
-                  << "Example: " << argv[0] << " 0.0.0.0 80\n";
-        return 1;
+        if (opt == 'k')
+            options.idle = std::chrono::seconds(std::stoul(optarg));
+        else if (opt == 't')
+            options.timeout = std::chrono::seconds(std::stoul(optarg));
+        else
+            usage = true;
     }
 
-    auto const host = net::ip::make_address(argv[1]);
-    auto const port = static_cast<unsigned short>(std::atoi(argv[2]));
-    auto const threads = static_cast<int>(std::thread::hardware_concurrency());
+    if (usage || (argc - optind != 2 && argc - optind != 3))
+    {
+        std::cerr << "Usage:   " << argv[0] << " [-k <idle seconds before a ping, 0 off>] [-t <pong timeout seconds>]\n"
+                  << "         <host> <port> [<shared|reuseport|pinned>]\n"
+                  << "Example: " << argv[0] << " 0.0.0.0 80 reuseport\n";
+        return 1;
+    }
 
-    net::io_context ioc{threads};
-    std::make_shared<listener>(ioc, endpoint_t{host, port})->run();
+    auto const host = net::ip::make_address(argv[optind]);
+    auto const port = static_cast<unsigned short>(std::atoi(argv[optind + 1]));
+    auto const threads = static_cast<size_t>(std::thread::hardware_concurrency());
+    auto const mode = to_runtime_mode(argc - optind == 3 ? argv[optind + 2] : "shared");
 
-    std::vector<std::thread> v;
-    v.reserve(threads - 1);
+    if (! mode)
+    {
+        std::cerr << "unknown runtime mode: " << argv[optind + 2] << "\n";
+        return 1;
+    }
 
-    for(auto i = threads - 1; i > 0; --i)
-        v.emplace_back([&ioc]{ ioc.run(); });
-    ioc.run();
+    // one heartbeat per io_context, they outlive the sessions
+    std::list<heartbeat> heartbeats;
+    runtime<net::io_context> rt{mode.value(), threads};
+    rt.listen([&](net::io_context& ioc, bool reuseport)
+    {
+        auto& beat = heartbeats.emplace_back(ioc, options);
+        beat.run();
+        std::make_shared<listener>(ioc, endpoint_t{host, port}, beat, reuseport)->run();
+    });
+    rt.run();
 
     return 0;
 }
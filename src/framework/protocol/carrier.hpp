@@ -1,9 +1,15 @@
 #ifndef CARRIER_HPP
 #define CARRIER_HPP
 
+#include <array>
 #include <memory>
 #include <vector>
+#include <algorithm>
 #include <cstddef>
+#include <limits>
+#include <utility>
+#include <stdexcept>
+#include <pool.hpp>
 #include <protocol.hpp>
 
 using byte_t = std::byte;
@@ -19,15 +25,168 @@ inline constexpr size_t length_size()
     return sizeof(length_t);
 }
   
+class slab
+{
+    public:
+        slab() = default;
+
+        slab(slab&& other) noexcept : data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0)), capacity_(std::exchange(other.capacity_, 0))
+        {
+        }
+
+        slab& operator=(slab&& other) noexcept
+        {
+            if (this != &other)
+            {
+                release();
+                data_ = std::exchange(other.data_, nullptr);
+                size_ = std::exchange(other.size_, 0);
+                capacity_ = std::exchange(other.capacity_, 0);
+            }
+            return *this;
+        }
+
+        ~slab()
+        {
+            release();
+        }
+
+        byte_t* prepare(size_t size)
+        {
+            if (size > capacity_)
+            {
+                release();
+                data_ = pool::acquire(size, capacity_);
+            }
+            size_ = size;
+            return data_;
+        }
+
+        // hand the block back to the pool so an idle session holds no payload memory
+        void release()
+        {
+            if (data_)
+                pool::release(data_, capacity_);
+            data_ = nullptr;
+            size_ = 0;
+            capacity_ = 0;
+        }
+
+        byte_t* data()
+        {
+            return data_;
+        }
+
+        const byte_t* data() const
+        {
+            return data_;
+        }
+
+        size_t size() const
+        {
+            return size_;
+        }
+
+    private:
+        byte_t* data_ = nullptr;
+        size_t size_ = 0;
+        size_t capacity_ = 0;
+};
+
+class frame
+{
+    public:
+        using header_t = std::array<byte_t, header_size()>;
+
+        header_t& header()
+        {
+            return header_;
+        }
+
+        const header_t& header() const
+        {
+            return header_;
+        }
+
+        slab& payload()
+        {
+            return payload_;
+        }
+
+        const slab& payload() const
+        {
+            return payload_;
+        }
+
+        size_t size() const
+        {
+            return header_.size() + payload_.size();
+        }
+
+        void assign(const frame& other)
+        {
+            header_ = other.header_;
+            std::copy_n(other.payload_.data(), other.payload_.size(), payload_.prepare(other.payload_.size()));
+        }
+
+        // copy a packed header + payload
+        void assign(const byte_t* data, size_t size)
+        {
+            std::copy_n(data, header_size(), header_.data());
+            std::copy_n(data + header_size(), size - header_size(), payload_.prepare(size - header_size()));
+        }
+
+    private:
+        alignas(protocol) header_t header_;
+        slab payload_;
+};
+
+// packed message that is written once and then only read, so one copy can sit in
+// any number of session queues; a single allocation holds the count and the bytes
+class shared_buffer
+{
+    public:
+        shared_buffer() = default;
+
+        explicit shared_buffer(size_t size) :
+        data_(std::make_shared_for_overwrite<byte_t[]>(size)), size_(size)
+        {
+        }
+
+        // bytes owned by something else, e.g. a mapped log segment kept alive by data
+        shared_buffer(std::shared_ptr<byte_t[]> data, size_t size) :
+        data_(std::move(data)), size_(size)
+        {
+        }
+
+        byte_t* data()
+        {
+            return data_.get();
+        }
+
+        const byte_t* data() const
+        {
+            return data_.get();
+        }
+
+        size_t size() const
+        {
+            return size_;
+        }
+
+    private:
+        std::shared_ptr<byte_t[]> data_;
+        size_t size_ = 0;
+};
+
 template <typename ProtocolBuffer>
 class carrier 
 {
     public:
-        using protocol_t = std::shared_ptr<protocol>;
         using message_t = std::shared_ptr<ProtocolBuffer>;
 
-        carrier() : header_(std::make_shared<protocol>()), 
-        message_(std::make_shared<ProtocolBuffer>())
+        carrier() : header_(), message_(std::make_shared<ProtocolBuffer>())
         {
         }
 
@@ -41,88 +200,86 @@ class carrier
            message_ = message;
         }
 
-        protocol_t header()
+        protocol& header()
         {
             return header_;
         }
 
-        void set_header(protocol_t header)
+        void set_header(const protocol& header)
         {
             header_ = header;
         }
 
         length_t decode_header(buffer_t& buffer)
         {
-            size_t i = 0;
-            auto mark = header_->mark();
-            mark[0] = std::to_integer<char>(buffer[i++]);
-            mark[1] = std::to_integer<char>(buffer[i++]);
-            header_->set_version(std::to_integer<uint8_t>(buffer[i++]));
-            header_->set_crypt(std::to_integer<uint8_t>(buffer[i++]));
-            length_t bytes_transferred = to_size<length_t>(buffer, i);
-            header_->set_length(bytes_transferred);
-            header_->set_mode(std::to_integer<uint8_t>(buffer[i++]));
-            header_->set_type(std::to_integer<uint8_t>(buffer[i++]));
-            header_->set_service(to_size<uint16_t>(buffer, i));
-            header_->set_agent(to_size<uint16_t>(buffer, i));
-            header_->set_error(to_size<uint16_t>(buffer, i));
-            header_->set_seq(to_size<uint32_t>(buffer, i));
-            header_->set_res(to_size<uint32_t>(buffer, i));
+            header_.decode(buffer.data());
+            length_t bytes_transferred = header_.length();
             buffer.resize(header_size() + bytes_transferred);
             return bytes_transferred;
         }
 
+        length_t decode_header(frame& frame)
+        {
+            header_.decode(frame.header().data());
+            length_t bytes_transferred = header_.length();
+            frame.payload().prepare(bytes_transferred);
+            return bytes_transferred;
+        }
+
         bool decode_message(const buffer_t& buffer)
         {
             return message_->ParseFromArray(std::addressof(buffer[header_size()]), buffer.size() - header_size());
         }
 
+        bool decode_message(const frame& frame)
+        {
+            return message_->ParseFromArray(frame.payload().data(), frame.payload().size());
+        }
+
+        bool decode_message(const byte_t* payload, size_t size)
+        {
+            return message_->ParseFromArray(payload, size);
+        }
+
         void pack(buffer_t& buffer)
         {
-            length_t bytes_transferred = message_->ByteSize();
-            header_->set_length(bytes_transferred);
+            length_t bytes_transferred = byte_size();
+            header_.set_length(bytes_transferred);
             buffer.resize(header_size() + bytes_transferred);
-            encode_header(buffer);
+            header_.encode(buffer.data());
             message_->SerializeToArray(std::addressof(buffer[header_size()]), bytes_transferred);
         }
 
+        void pack(frame& frame)
+        {
+            length_t bytes_transferred = byte_size();
+            header_.set_length(bytes_transferred);
+            header_.encode(frame.header().data());
+            message_->SerializeToArray(frame.payload().prepare(bytes_transferred), bytes_transferred);
+        }
+
+        // always a fresh buffer, earlier ones may still be queued elsewhere
+        void pack(shared_buffer& buffer)
+        {
+            length_t bytes_transferred = byte_size();
+            header_.set_length(bytes_transferred);
+            buffer = shared_buffer(header_size() + bytes_transferred);
+            header_.encode(buffer.data());
+            message_->SerializeToArray(buffer.data() + header_size(), bytes_transferred);
+        }
+
     private:
-        template <typename T>
-        T to_size(const buffer_t& buffer, size_t& i)
-        {
-            T size = 0;
-            for (size_t j = 0; j != sizeof(T); ++j)
-                 size = (size << 8) + (std::to_integer<T>(buffer[i++]) & 0xFF);
-            return size;
-        }
-            
-        template <typename T, typename B>
-        void to_byte(buffer_t& buffer, size_t& i, T value)
-        {
-            for (size_t j = 0; j != sizeof(T); ++j)
-                 buffer[i++] = static_cast<B>((value >> ((sizeof(T) - j - 1) * 8)) & 0xFF);
-        }
-        
-        void encode_header(buffer_t& buffer)
-        {
-            size_t i = 0;
-            auto mark = header_->mark();
-            buffer[i++] = static_cast<byte_t>(mark[0]);
-            buffer[i++] = static_cast<byte_t>(mark[1]);
-            buffer[i++] = static_cast<byte_t>(header_->version());
-            buffer[i++] = static_cast<byte_t>(header_->crypt());
-            to_byte<length_t, byte_t>(buffer, i, header_->length());
-            buffer[i++] = static_cast<byte_t>(header_->mode());
-            buffer[i++] = static_cast<byte_t>(header_->type());
-            to_byte<uint16_t, byte_t>(buffer, i, header_->service());
-            to_byte<uint16_t, byte_t>(buffer, i, header_->agent());
-            to_byte<uint16_t, byte_t>(buffer, i, header_->error());
-            to_byte<length_t, byte_t>(buffer, i, header_->seq());
-            to_byte<length_t, byte_t>(buffer, i, header_->res());
+        // the header carries the payload length in a length_t
+        length_t byte_size() const
+        {
+            size_t size = message_->ByteSizeLong();
+            if (size > std::numeric_limits<length_t>::max())
+                throw std::length_error("carrier message too large");
+            return static_cast<length_t>(size);
         }
 
     private:
-        protocol_t header_;
+        protocol header_;
         message_t message_;
 };
 
@@ -0,0 +1,150 @@
+#ifndef DECODER_HPP
+#define DECODER_HPP
+
+#include <cstring>
+#include <optional>
+#include <carrier.hpp>
+
+// streaming frame decoder: a session reads whatever the socket has into one buffer
+// and takes every complete frame out of it per wakeup, instead of two reads per
+// message. a frame bigger than the buffer is spilled into a pooled frame so its
+// payload can be read straight into place. a header announcing a frame longer
+// than max_frame is never allocated for, prepare() and spill() report it instead.
+class decoder
+{
+    public:
+        struct view
+        {
+            protocol header;
+            byte_t* data;
+            size_t size;
+        };
+
+        explicit decoder(size_t capacity = 16 * 1024, size_t max_frame = 16 * 1024 * 1024) :
+        capacity_(capacity), max_frame_(max_frame)
+        {
+        }
+
+        // free space to read into; only valid after consume(). a null pointer means
+        // the frame at the front is longer than max_frame and the peer should go
+        std::pair<byte_t*, size_t> prepare()
+        {
+            size_t need = pending();
+            if (need > max_frame_)
+                return { nullptr, 0 };
+
+            if (! buffer_.data())
+                buffer_.prepare(capacity_);
+            if (buffer_.size() - begin_ < need || (begin_ && buffer_.size() - end_ < capacity_ / 4))
+            {
+                if (need > buffer_.size())
+                {
+                    slab grown;
+                    std::memcpy(grown.prepare(need), buffer_.data() + begin_, end_ - begin_);
+                    buffer_ = std::move(grown);
+                }
+                else
+                    std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+                end_ -= begin_;
+                cursor_ -= begin_;
+                begin_ = 0;
+            }
+            return { buffer_.data() + end_, buffer_.size() - end_ };
+        }
+
+        void commit(size_t size)
+        {
+            end_ += size;
+        }
+
+        // next complete frame; it stays valid until consume()
+        std::optional<view> next()
+        {
+            if (end_ - cursor_ < header_size())
+                return {};
+
+            view frame;
+            frame.header.decode(buffer_.data() + cursor_);
+            frame.size = header_size() + frame.header.length();
+            if (end_ - cursor_ < frame.size)
+                return {};
+
+            frame.data = buffer_.data() + cursor_;
+            cursor_ += frame.size;
+            return frame;
+        }
+
+        // the complete frames returned by next() as one contiguous region
+        byte_t* data()
+        {
+            return buffer_.data() + begin_;
+        }
+
+        size_t ready() const
+        {
+            return cursor_ - begin_;
+        }
+
+        void consume()
+        {
+            begin_ = cursor_;
+            if (begin_ != end_)
+                return;
+
+            begin_ = end_ = cursor_ = 0;
+            if (buffer_.size() > capacity_)
+                buffer_.release();
+        }
+
+        // give the buffer back to the pool if nothing is left in it, an idle reader
+        // then holds no memory until the next prepare()
+        void release()
+        {
+            if (begin_ == end_)
+                buffer_.release();
+        }
+
+        // if the partial frame at the front cannot fit in the buffer, move its header
+        // and the payload read so far into frame and return how much payload is still
+        // missing; the caller reads that into frame.payload() at the same offset
+        std::optional<size_t> spill(frame& frame)
+        {
+            if (end_ - cursor_ < header_size())
+                return {};
+
+            protocol header;
+            header.decode(buffer_.data() + cursor_);
+            size_t length = header.length();
+            if (header_size() + length <= capacity_ || header_size() + length > max_frame_)
+                return {};
+
+            size_t available = end_ - cursor_ - header_size();
+            std::memcpy(frame.header().data(), buffer_.data() + cursor_, header_size());
+            std::memcpy(frame.payload().prepare(length), buffer_.data() + cursor_ + header_size(), available);
+            cursor_ = end_;
+            consume();
+            return length - available;
+        }
+
+        // bytes needed to complete the frame at the front of the buffer, which is
+        // what the next prepare() grows it to
+        size_t pending() const
+        {
+            if (end_ - begin_ < header_size())
+                return header_size();
+
+            protocol header;
+            header.decode(buffer_.data() + begin_);
+            return header_size() + header.length();
+        }
+
+    private:
+        size_t capacity_;
+        size_t max_frame_;
+        size_t begin_ = 0;
+        size_t cursor_ = 0;
+        size_t end_ = 0;
+        slab buffer_;
+};
+
+#endif
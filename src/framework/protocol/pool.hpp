@@ -0,0 +1,112 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <bit>
+#include <array>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <algorithm>
+
+// size-class allocator for message payloads: power of two classes from 64 bytes
+// to 4 MB, each with a thread-local free list, so steady-state messaging reuses
+// the same blocks instead of going to malloc. larger blocks bypass the pool.
+class pool
+{
+    public:
+        static constexpr size_t classes = 17;
+        static constexpr size_t min_block = 64;
+        static constexpr size_t max_block = min_block << (classes - 1);
+        static constexpr size_t cache_bytes = 8 * 1024 * 1024;
+
+        static std::byte* acquire(size_t size, size_t& capacity)
+        {
+            if (size > max_block)
+            {
+                stats_[classes].misses.fetch_add(1, std::memory_order_relaxed);
+                capacity = size;
+                return new std::byte[size];
+            }
+
+            size_t index = to_class(size);
+            capacity = min_block << index;
+            if (! destroyed_)
+            {
+                auto& blocks = cache_.free[index];
+                if (! blocks.empty())
+                {
+                    stats_[index].hits.fetch_add(1, std::memory_order_relaxed);
+                    std::byte* data = blocks.back();
+                    blocks.pop_back();
+                    return data;
+                }
+            }
+            stats_[index].misses.fetch_add(1, std::memory_order_relaxed);
+            return new std::byte[capacity];
+        }
+
+        static void release(std::byte* data, size_t capacity)
+        {
+            if (capacity > max_block || destroyed_)
+            {
+                delete[] data;
+                return;
+            }
+
+            size_t index = to_class(capacity);
+            auto& blocks = cache_.free[index];
+            if (blocks.size() < std::max<size_t>(4, cache_bytes / capacity))
+                blocks.push_back(data);
+            else
+                delete[] data;
+        }
+
+        static void report(std::ostream& out)
+        {
+            for (size_t i = 0; i <= classes; ++i)
+            {
+                size_t hits = stats_[i].hits.load(std::memory_order_relaxed);
+                size_t misses = stats_[i].misses.load(std::memory_order_relaxed);
+                if (hits == 0 && misses == 0)
+                    continue;
+                if (i == classes)
+                    out << "pool >" << max_block;
+                else
+                    out << "pool " << (min_block << i);
+                out << ": " << hits << " hits, " << misses << " misses\n";
+            }
+        }
+
+    private:
+        static size_t to_class(size_t size)
+        {
+            return size <= min_block ? 0 : std::bit_width(size - 1) - std::bit_width(min_block - 1);
+        }
+
+        struct cache
+        {
+            ~cache()
+            {
+                destroyed_ = true;
+                for (auto& blocks : free)
+                    for (auto* data : blocks)
+                        delete[] data;
+            }
+
+            std::array<std::vector<std::byte*>, classes> free;
+        };
+
+        struct alignas(64) counters
+        {
+            std::atomic<size_t> hits;
+            std::atomic<size_t> misses;
+        };
+
+        static inline thread_local cache cache_;
+        static inline thread_local bool destroyed_ = false;
+        static inline std::array<counters, classes + 1> stats_;
+};
+
+#endif
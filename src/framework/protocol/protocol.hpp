@@ -1,10 +1,49 @@
 #ifndef PROTOCOL_HPP
 #define PROTOCOL_HPP
 
+#include <bit>
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
 
 using length_t = uint32_t;
 
+enum class mode_type : uint8_t
+{
+    request = 0,
+    response = 1,
+    notify = 2,
+    subscribe = 3,
+    unsubscribe = 4,
+    ping = 5,
+    pong = 6
+};
+
+enum class error_type : uint16_t
+{
+    none = 0,
+    timeout = 1,
+    unauthorized = 2,
+    unavailable = 3,
+    gap = 4,
+    busy = 5
+};
+
+template <typename T>
+inline constexpr T big_endian(T value)
+{
+    static_assert(std::is_unsigned_v<T>);
+    if constexpr (std::endian::native == std::endian::big || sizeof(T) == 1)
+        return value;
+    else if constexpr (sizeof(T) == 2)
+        return __builtin_bswap16(value);
+    else if constexpr (sizeof(T) == 4)
+        return __builtin_bswap32(value);
+    else
+        return __builtin_bswap64(value);
+}
+
 class protocol
 {
     public:
@@ -122,6 +161,70 @@ class protocol
             res_ = res;
         }
 
+        void decode(const std::byte* data)
+        {
+            std::memcpy(this, data, sizeof(protocol));
+            swap();
+        }
+
+        // fields go straight to the wire; swapping a copy and then copying that
+        // out reads back bytes just stored and stalls on store forwarding
+        void encode(std::byte* data) const
+        {
+            std::memcpy(data, this, sizeof(protocol));
+            put(data, offsetof(protocol, length_), length_);
+            put(data, offsetof(protocol, service_), service_);
+            put(data, offsetof(protocol, agent_), agent_);
+            put(data, offsetof(protocol, error_), error_);
+            put(data, offsetof(protocol, seq_), seq_);
+            put(data, offsetof(protocol, res_), res_);
+        }
+
+        static void patch_error(std::byte* data, uint16_t error)
+        {
+            put(data, offsetof(protocol, error_), error);
+        }
+
+        static void patch_seq(std::byte* data, uint32_t seq)
+        {
+            put(data, offsetof(protocol, seq_), seq);
+        }
+
+        static void patch_res(std::byte* data, uint32_t res)
+        {
+            put(data, offsetof(protocol, res_), res);
+        }
+
+        static void patch_mode(std::byte* data, mode_type mode)
+        {
+            data[offsetof(protocol, mode_)] = static_cast<std::byte>(mode);
+        }
+
+    private:
+        template <typename T>
+        static void put(std::byte* data, size_t offset, T value)
+        {
+            value = big_endian(value);
+            std::memcpy(data + offset, &value, sizeof(value));
+        }
+
+        // the wire header is this class in network byte order, see carrier.proto
+        void swap()
+        {
+            static_assert(offsetof(protocol, length_) == 4);
+            static_assert(offsetof(protocol, service_) == 10);
+            static_assert(offsetof(protocol, error_) == 14);
+            static_assert(offsetof(protocol, seq_) == 16);
+            static_assert(offsetof(protocol, res_) == 20);
+
+            length_ = big_endian(length_);
+            service_ = big_endian(service_);
+            agent_ = big_endian(agent_);
+            error_ = big_endian(error_);
+            seq_ = big_endian(seq_);
+            res_ = big_endian(res_);
+        }
+
     private:
         char       mark_[2];   // debug prefix
         uint8_t    version_;   // protocol version
@@ -136,4 +239,7 @@ class protocol
         uint32_t   res_;       // reserved for future use
 };
 
+static_assert(sizeof(protocol) == 24 && alignof(protocol) == 4);
+static_assert(std::is_trivially_copyable_v<protocol> && std::is_standard_layout_v<protocol>);
+
 #endif
@@ -0,0 +1,189 @@
+#ifndef AUTHENTICATOR_HPP
+#define AUTHENTICATOR_HPP
+
+#include <mutex>
+#include <tuple>
+#include <fstream>
+#include <sstream>
+#include <lru.hpp>
+#include <protocol.hpp>
+#include <net.hpp>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+
+// checks logins against users.conf (username, salt and pbkdf2-sha256 of the
+// password, both hex) on its own thread, since one check costs thousands of hash
+// rounds. a login that passed is remembered in an lru as a single sha256 of salt
+// and password, so a reconnect storm of known users costs one hash per login.
+// an unknown username is checked against a random dummy user, so the time to
+// reject it is the same as for a wrong password. at most max_pending checks wait
+// for the thread, and a source address that failed max_failures times is turned
+// away without a check until lockout has passed since its last failure. both are
+// reported as busy, which the client retries later, so nobody can lock out an
+// account by failing logins to it.
+class authenticator
+{
+    public:
+        static constexpr int iterations = 10000;
+        static constexpr size_t max_pending = 256;
+        static constexpr uint32_t max_failures = 10;
+        static constexpr std::chrono::seconds lockout{60};
+
+        explicit authenticator(size_t cache_size = 65536, std::chrono::seconds ttl = std::chrono::minutes(10)) :
+        cache_(cache_size, ttl), failures_(cache_size, lockout), dummy_{ random(16), random(32) },
+        work_(net::make_work_guard(ioc_))
+        {
+        }
+
+        ~authenticator()
+        {
+            work_.reset();
+            ioc_.stop();
+            if (thread_.joinable())
+                thread_.join();
+        }
+
+        bool load(const char* path)
+        {
+            std::ifstream fin(path);
+            if (! fin)
+            {
+                fail(std::make_error_code(std::errc::no_such_file_or_directory), path);
+                return false;
+            }
+
+            for (std::string line; std::getline(fin, line);)
+            {
+                if (line.empty() || line[0] == '#')
+                    continue;
+
+                std::istringstream in(line);
+                std::string username, salt, key;
+                if (in >> username >> salt >> key)
+                    users_.try_emplace(username, user{ unhex(salt), unhex(key) });
+            }
+
+            thread_ = std::thread([this]{ ioc_.run(); });
+            return true;
+        }
+
+        // done(error_type) is posted to ioc, the caller's io_context. concurrent logins
+        // with the same credentials share one check. a throttled source is turned
+        // away before the cache is looked at, so it cannot guess against it either.
+        template <typename F>
+        void verify(net::io_context& ioc, const std::string& source, const std::string& username, const std::string& password, F&& done)
+        {
+            auto it = users_.find(username);
+            bool known = it != users_.end();
+            const user& account = known ? it->second : dummy_;
+
+            auto digest = hash(account.salt, password);
+            auto key = username + '\n' + digest;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto failed = failures_.get(source);
+                bool busy = pending_.size() >= max_pending && pending_.find(key) == pending_.end();
+                if (busy || (failed && failed.value() >= max_failures))
+                {
+                    net::post(ioc, [done = std::forward<F>(done)]() mutable { done(error_type::busy); });
+                    return;
+                }
+
+                auto cached = cache_.get(username);
+                if (cached && equal(cached.value(), digest))
+                {
+                    net::post(ioc, [done = std::forward<F>(done)]() mutable { done(error_type::none); });
+                    return;
+                }
+
+                auto [waiting, first] = pending_.try_emplace(key);
+                waiting->second.emplace_back(&ioc, source, std::forward<F>(done));
+                if (! first)
+                    return;
+            }
+
+            net::post(ioc_,
+            [this, &account, known, username, password, key = std::move(key), digest = std::move(digest)]() mutable
+            {
+                bool ok = check(account, password) && known;
+                waiters_t waiters;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (ok)
+                        cache_.put(username, std::move(digest));
+                    waiters = std::move(pending_[key]);
+                    pending_.erase(key);
+                    // every source that tried the wrong password pays for it
+                    if (! ok)
+                        for (auto& [ioc, source, done] : waiters)
+                            failures_.put(source, failures_.get(source).value_or(0) + 1);
+                }
+                auto error = ok ? error_type::none : error_type::unauthorized;
+                for (auto& [ioc, source, done] : waiters)
+                    net::post(*ioc, [error, done = std::move(done)]() mutable { done(error); });
+            });
+        }
+
+    private:
+        struct user
+        {
+            std::string salt;
+            std::string key;
+        };
+
+        static std::string unhex(const std::string& hex)
+        {
+            std::string bytes;
+            for (size_t i = 0; i + 1 < hex.size(); i += 2)
+                bytes.push_back(static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+            return bytes;
+        }
+
+        static std::string random(size_t size)
+        {
+            std::string bytes(size, '\0');
+            RAND_bytes(reinterpret_cast<unsigned char*>(bytes.data()), bytes.size());
+            return bytes;
+        }
+
+        // secrets are compared in time that does not depend on where they differ
+        static bool equal(const std::string& a, const std::string& b)
+        {
+            return a.size() == b.size() && CRYPTO_memcmp(a.data(), b.data(), a.size()) == 0;
+        }
+
+        static bool check(const user& user, const std::string& password)
+        {
+            std::string key(user.key.size(), '\0');
+            if (! PKCS5_PBKDF2_HMAC(password.data(), password.size(),
+                                    reinterpret_cast<const unsigned char*>(user.salt.data()), user.salt.size(),
+                                    iterations, EVP_sha256(), key.size(), reinterpret_cast<unsigned char*>(key.data())))
+                return false;
+            return equal(key, user.key);
+        }
+
+        static std::string hash(const std::string& salt, const std::string& password)
+        {
+            std::string data = salt + password;
+            std::string digest(EVP_MAX_MD_SIZE, '\0');
+            unsigned int size = 0;
+            EVP_Digest(data.data(), data.size(), reinterpret_cast<unsigned char*>(digest.data()), &size, EVP_sha256(), nullptr);
+            digest.resize(size);
+            return digest;
+        }
+
+        using waiters_t = std::vector<std::tuple<net::io_context*, std::string, std::function<void (error_type)>>>;
+
+        std::unordered_map<std::string, user> users_;
+        std::mutex mutex_;
+        lru<std::string, std::string> cache_;
+        lru<std::string, uint32_t> failures_;
+        std::unordered_map<std::string, waiters_t> pending_;
+        user dummy_;
+        net::io_context ioc_;
+        net::executor_work_guard<net::io_context::executor_type> work_;
+        std::thread thread_;
+};
+
+#endif
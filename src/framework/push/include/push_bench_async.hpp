@@ -0,0 +1,116 @@
+#ifndef PUSH_BENCH_ASYNC_HPP
+#define PUSH_BENCH_ASYNC_HPP
+
+#include <atomic>
+#include <net.hpp>
+#include <heartbeat.hpp>
+#include <login.pb.h>
+
+struct stats
+{
+    std::atomic<size_t> connected = 0;
+    std::atomic<size_t> messages = 0;
+};
+
+// subscriber that logs in and then only counts the messages pushed to it
+class session : public std::enable_shared_from_this<session>
+{
+    public:
+        session(net::io_context& ioc, stats& stats, uint16_t topic) :
+        socket_(ioc), stats_(stats), topic_(topic)
+        {
+        }
+
+        std::shared_ptr<session> shared_this()
+        {
+            return shared_from_this();
+        }
+
+        void run(const results_t& results)
+        {
+            net::async_connect(socket_, results,
+            [self = shared_this()](error_code_t ec, const endpoint_t&)
+            {
+                self->on_connect(ec);
+            });
+        }
+
+        void on_connect(error_code_t ec)
+        {
+            if (ec)
+                return fail(ec, "connect");
+
+            login_.message()->set_username("root");
+            login_.message()->set_password("****");
+            login_.header().set_service(topic_);
+            login_.pack(frame_);
+            net::async_write(socket_, buffers(frame_),
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                self->on_login(ec, bytes_transferred);
+            });
+        }
+
+        void on_login(error_code_t ec, size_t bytes_transferred)
+        {
+            if (ec)
+                return fail(ec, "write");
+
+            ++stats_.connected;
+            do_read();
+        }
+
+        void do_read()
+        {
+            auto [data, size] = decoder_.prepare();
+            if (! data)
+                return on_read(std::make_error_code(std::errc::message_size), 0);
+
+            socket_.async_read_some(net::buffer(data, size),
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                self->on_read(ec, bytes_transferred);
+            });
+        }
+
+        void on_read(error_code_t ec, size_t bytes_transferred)
+        {
+            if (ec)
+                return fail(ec, "read");
+
+            decoder_.commit(bytes_transferred);
+            size_t messages = 0;
+            while (auto view = decoder_.next())
+            {
+                if (static_cast<mode_type>(view->header.mode()) == mode_type::ping)
+                    do_pong();
+                else
+                    ++messages;
+            }
+            decoder_.consume();
+
+            stats_.messages.fetch_add(messages, std::memory_order_relaxed);
+            do_read();
+        }
+
+        void do_pong()
+        {
+            net::async_write(socket_, net::buffer(pong_),
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                if (ec)
+                    fail(ec, "write");
+            });
+        }
+
+    private:
+        socket_t socket_;
+        stats& stats_;
+        uint16_t topic_;
+        frame frame_;
+        frame::header_t pong_ = control_header(mode_type::pong);
+        decoder decoder_;
+        carrier<pb::login> login_;
+};
+
+#endif
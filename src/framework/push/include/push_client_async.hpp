@@ -2,12 +2,20 @@
 #define PUSH_CLIENT_ASYNC_HPP
 
 #include <net.hpp>
+#include <outbox.hpp>
+#include <heartbeat.hpp>
+#include <login.pb.h>
 
+// subscriber that reconnects on its own, backing off from min_backoff to
+// max_backoff until a login is welcomed again
 class session : public std::enable_shared_from_this<session>
 {
     public:
-        explicit session(net::io_context& ioc, const std::string& username, const std::string& password) :
-        resolver_(ioc), socket_(ioc), username_(username), password_(password)
+        static constexpr std::chrono::milliseconds min_backoff{1000};
+        static constexpr std::chrono::milliseconds max_backoff{30000};
+
+        explicit session(net::io_context& ioc, const std::string& username, const std::string& password, uint16_t topic = 0) :
+        resolver_(ioc), socket_(ioc), timer_(ioc), username_(username), password_(password), topic_(topic)
         {
         }
 
@@ -18,6 +26,8 @@ class session : public std::enable_shared_from_this<session>
 
         void run(const std::string& host, const std::string& port)
         {
+            host_ = host;
+            port_ = port;
             resolver_.async_resolve(host, port,
             [self = shared_this()](error_code_t ec, results_t results)
             {
@@ -28,7 +38,10 @@ class session : public std::enable_shared_from_this<session>
         void on_resolve(error_code_t ec, results_t results)
         {
             if (ec)
-                return fail(ec, "resolve");
+            {
+                fail(ec, "resolve");
+                return do_reconnect();
+            }
 
             net::async_connect(socket_, results,
             std::bind(&session::on_connect, shared_this(), std::placeholders::_1));
@@ -37,29 +50,30 @@ class session : public std::enable_shared_from_this<session>
         void on_connect(error_code_t ec)
         {
             if (ec)
-               return fail(ec, "connect");
+            {
+                fail(ec, "connect");
+                return do_reconnect();
+            }
 
-            if (login())
-                do_read_header();
+            connected_ = true;
+            do_login();
         }
 
-        bool login()
+        // after a reconnect the login carries the last seq seen, the server then
+        // replays what the topic published in between right after the reply
+        void do_login()
         {
-            auto message = carrier_.message();
-            message->set_message("login message");
-
-            carrier_.pack(buffer_);
-            net::write(socket_, net::buffer(buffer_));
-
-            buffer_.resize(header_size());
-            net::read(socket_, net::buffer(buffer_));
-
-            size_t size = carrier_.decode_header(buffer_);
-            net::read(socket_, net::buffer(std::addressof(buffer_[header_size()]), size));
-
-            carrier_.decode_message(buffer_);
-            std::cout << carrier_.message()->message() << std::endl;
-            return true;
+            auto message = login_.message();
+            message->set_username(username_);
+            message->set_password(password_);
+            login_.header().set_mode(static_cast<uint8_t>(mode_type::request));
+            login_.header().set_service(topic_);
+            login_.header().set_seq(seq_);
+
+            buffer_t login;
+            login_.pack(login);
+            send(std::move(login));
+            do_read_header();
         }
 
         void do_read_header()
@@ -74,8 +88,11 @@ class session : public std::enable_shared_from_this<session>
 
         void on_read_header(error_code_t ec, size_t bytes_transferred)
         {
-            if (ec == net::error::eof)
-                return fail(ec, "read");
+            if (ec)
+            {
+                fail(ec, "read");
+                return do_reconnect();
+            }
 
             do_read_message();
         }
@@ -92,28 +109,117 @@ class session : public std::enable_shared_from_this<session>
         
         void on_read_message(error_code_t ec, size_t bytes_transferred)
         {
-            if (ec == net::error::eof)
-                return fail(ec, "read");
+            if (ec)
+            {
+                fail(ec, "read");
+                return do_reconnect();
+            }
 
+            auto& header = carrier_.header();
+            if (static_cast<mode_type>(header.mode()) == mode_type::ping)
+                return do_pong();
+
+            if (static_cast<mode_type>(header.mode()) == mode_type::response)
+            {
+                login_.decode_message(buffer_);
+                std::cout << login_.message()->message() << std::endl;
+                auto error = static_cast<error_type>(header.error());
+                if (error == error_type::unauthorized)
+                    return do_close();
+                // the server is too busy to check the login, or throttles this address
+                if (error == error_type::busy)
+                    return do_reconnect();
+                if (error == error_type::none)
+                    backoff_ = min_backoff;
+                // the server could not replay everything since seq_, a real client
+                // reloads the topic's state here and carries on from the given seq
+                if (error == error_type::gap)
+                    seq_ = header.seq();
+                return do_read_header();
+            }
+
+            if (static_cast<mode_type>(header.mode()) == mode_type::notify)
+                seq_ = header.seq();
             carrier_.decode_message(buffer_);
             std::cout << carrier_.message()->message() << std::endl;
             do_read_header();
         }
 
+        // the pong goes out while the next header is read
+        void do_pong()
+        {
+            send(buffer_t(pong_.begin(), pong_.end()));
+            do_read_header();
+        }
+
+        // the login and every pong share one queue, so only one write is ever in flight
+        void send(buffer_t buffer)
+        {
+            if (frames_.push(std::move(buffer)))
+                do_write();
+        }
+
+        void do_write()
+        {
+            net::async_write(socket_, frames_.flush(),
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                self->on_write(ec, bytes_transferred);
+            });
+        }
+
+        // a write cancelled by a reconnect hands over to the login queued behind it;
+        // any other failure closes, and the read that fails with it reconnects
+        void on_write(error_code_t ec, size_t bytes_transferred)
+        {
+            if (ec && ec != std::errc::operation_canceled)
+            {
+                fail(ec, "write");
+                do_close();
+            }
+
+            if (frames_.written() && connected_)
+                do_write();
+        }
+
         void do_close()
         {
+            connected_ = false;
             error_code_t ec;
             socket_.shutdown(net::socket_base::shutdown_both, ec);
             socket_.close(ec);
         }
 
+        void do_reconnect()
+        {
+            do_close();
+            timer_.expires_after(backoff_);
+            backoff_ = std::min(backoff_ * 2, max_backoff);
+            timer_.async_wait(
+            [self = shared_this()](error_code_t ec)
+            {
+                if (! ec)
+                    self->run(self->host_, self->port_);
+            });
+        }
+
     private:
         tcp::resolver resolver_;
         socket_t socket_;
+        net::steady_timer timer_;
+        std::string host_;
+        std::string port_;
         std::string username_;
         std::string password_;
+        uint16_t topic_;
+        uint32_t seq_ = 0;
+        std::chrono::milliseconds backoff_ = min_backoff;
+        bool connected_ = false;
+        outbox<buffer_t> frames_;
         buffer_t buffer_;
         carrier_t carrier_;
+        carrier<pb::login> login_;
+        frame::header_t pong_ = control_header(mode_type::pong);
 };
 
 #endif
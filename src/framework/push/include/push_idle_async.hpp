@@ -0,0 +1,183 @@
+#ifndef PUSH_IDLE_ASYNC_HPP
+#define PUSH_IDLE_ASYNC_HPP
+
+#include <atomic>
+#include <fstream>
+#include <net.hpp>
+#include <heartbeat.hpp>
+#include <login.pb.h>
+
+struct stats
+{
+    std::atomic<size_t> connected = 0;
+    std::atomic<size_t> failed = 0;
+};
+
+// resident set size of a process in bytes, 0 if it cannot be read
+inline size_t resident(int pid)
+{
+    std::ifstream fin("/proc/" + std::to_string(pid) + "/status");
+    for (std::string line; std::getline(fin, line);)
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            return std::stoul(line.substr(6)) * 1024;
+    return 0;
+}
+
+// subscriber that logs in, reads the reply and then only waits for the socket to
+// become readable, holding no buffer, so the harness itself stays small at high
+// counts; pings are answered out of a stack buffer
+class session : public std::enable_shared_from_this<session>
+{
+    public:
+        session(net::io_context& ioc, stats& stats, uint16_t topic) :
+        socket_(ioc), stats_(stats), topic_(topic)
+        {
+        }
+
+        std::shared_ptr<session> shared_this()
+        {
+            return shared_from_this();
+        }
+
+        // one loopback source address per 25000 connections to stay within the
+        // ephemeral port range
+        void run(const endpoint_t& endpoint, size_t index)
+        {
+            error_code_t ec;
+            socket_.open(endpoint.protocol(), ec);
+            if (! ec && endpoint.address().is_loopback() && endpoint.address().is_v4())
+            {
+                auto source = net::ip::address_v4(net::ip::address_v4::loopback().to_uint() + 1 + index / 25000);
+                socket_.bind(endpoint_t{source, 0}, ec);
+            }
+            if (ec)
+            {
+                ++stats_.failed;
+                return fail(ec, "bind");
+            }
+
+            socket_.async_connect(endpoint,
+            [self = shared_this()](error_code_t ec)
+            {
+                self->on_connect(ec);
+            });
+        }
+
+        void on_connect(error_code_t ec)
+        {
+            if (ec)
+            {
+                ++stats_.failed;
+                return fail(ec, "connect");
+            }
+
+            carrier<pb::login> login;
+            login.message()->set_username("root");
+            login.message()->set_password("****");
+            login.header().set_service(topic_);
+            login.pack(buffer_);
+            net::async_write(socket_, net::buffer(buffer_),
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                self->on_login(ec, bytes_transferred);
+            });
+        }
+
+        void on_login(error_code_t ec, size_t bytes_transferred)
+        {
+            if (ec)
+            {
+                ++stats_.failed;
+                return fail(ec, "write");
+            }
+
+            buffer_.resize(header_size());
+            net::async_read(socket_, net::buffer(buffer_),
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                self->on_read_header(ec, bytes_transferred);
+            });
+        }
+
+        void on_read_header(error_code_t ec, size_t bytes_transferred)
+        {
+            if (ec)
+            {
+                ++stats_.failed;
+                return fail(ec, "read");
+            }
+
+            protocol header;
+            header.decode(buffer_.data());
+            if (static_cast<error_type>(header.error()) != error_type::none)
+            {
+                ++stats_.failed;
+                return;
+            }
+
+            buffer_.resize(header.length());
+            net::async_read(socket_, net::buffer(buffer_),
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                self->on_read_reply(ec, bytes_transferred);
+            });
+        }
+
+        void on_read_reply(error_code_t ec, size_t bytes_transferred)
+        {
+            if (ec)
+            {
+                ++stats_.failed;
+                return fail(ec, "read");
+            }
+
+            buffer_ = buffer_t();
+            ++stats_.connected;
+            do_wait();
+        }
+
+        void do_wait()
+        {
+            socket_.async_wait(net::socket_base::wait_read,
+            [self = shared_this()](error_code_t ec)
+            {
+                self->on_wait(ec);
+            });
+        }
+
+        // anything but whole bare headers (a notify burst) is skipped
+        void on_wait(error_code_t ec)
+        {
+            std::array<byte_t, 256> data;
+            size_t size = ec ? 0 : socket_.read_some(net::buffer(data), ec);
+            if (ec)
+            {
+                --stats_.connected;
+                ++stats_.failed;
+                return;
+            }
+
+            for (size_t offset = 0; offset + header_size() <= size; offset += header_size())
+            {
+                protocol header;
+                header.decode(data.data() + offset);
+                if (header.length() != 0)
+                    break;
+                if (static_cast<mode_type>(header.mode()) == mode_type::ping)
+                    net::async_write(socket_, net::buffer(pong_),
+                    [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+                    {
+                    });
+            }
+            do_wait();
+        }
+
+    private:
+        socket_t socket_;
+        stats& stats_;
+        uint16_t topic_;
+        buffer_t buffer_;
+        frame::header_t pong_ = control_header(mode_type::pong);
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef PUSH_PUBLISHER_ASYNC_HPP
+#define PUSH_PUBLISHER_ASYNC_HPP
+
+#include <ctime>
+#include <string>
+#include <net.hpp>
+
+std::string timestamp()
+{
+    char date[80];
+    timespec tp;
+    clock_gettime(CLOCK_REALTIME, &tp);
+    tm* timeinfo = localtime(static_cast<time_t*>(&tp.tv_sec));
+    strftime(date, 80, "%Y-%m-%d-%H:%M:%S", timeinfo);
+    return std::string(date);
+}
+
+std::string prepend_timestamp(const std::string& message)
+{
+    std::string time("<");
+    time.append(timestamp());
+    time.append(1, '>');
+    time.append(1, ' ');
+    time.append(message);
+    return time;
+}
+
+// "@<topic> <message>" publishes to a topic, anything else goes to topic 0
+uint16_t split_topic(std::string& line)
+{
+    if (line.size() < 2 || line[0] != '@')
+        return 0;
+
+    size_t end = line.find(' ');
+    uint16_t topic = static_cast<uint16_t>(std::atoi(line.c_str() + 1));
+    line.erase(0, end == std::string::npos ? line.size() : end + 1);
+    return topic;
+}
+
+// backend side of the push ingestion port: messages are packed into one pending
+// buffer and go out together in a single write on flush()
+class publisher
+{
+    public:
+        explicit publisher(net::io_context& ioc) : ioc_(ioc), socket_(ioc)
+        {
+            carrier_.header().set_mode(static_cast<uint8_t>(mode_type::notify));
+        }
+
+        bool connect(const std::string& host, const std::string& port)
+        {
+            error_code_t ec;
+            tcp::resolver resolver(ioc_);
+            auto const results = resolver.resolve(host, port, ec);
+            if (! ec)
+                net::connect(socket_, results, ec);
+            if (ec)
+                fail(ec, "connect");
+            return ! ec;
+        }
+
+        void publish(uint16_t topic, const std::string& message)
+        {
+            carrier_.message()->set_message(message);
+            carrier_.header().set_service(topic);
+            carrier_.pack(frame_);
+
+            auto const& header = frame_.header();
+            auto const& payload = frame_.payload();
+            batch_.insert(batch_.end(), header.begin(), header.end());
+            batch_.insert(batch_.end(), payload.data(), payload.data() + payload.size());
+        }
+
+        size_t pending() const
+        {
+            return batch_.size();
+        }
+
+        bool flush()
+        {
+            error_code_t ec;
+            net::write(socket_, net::buffer(batch_), ec);
+            batch_.clear();
+            if (ec)
+                fail(ec, "write");
+            return ! ec;
+        }
+
+    private:
+        net::io_context& ioc_;
+        socket_t socket_;
+        frame frame_;
+        buffer_t batch_;
+        carrier_t carrier_;
+};
+
+#endif
@@ -1,169 +1,754 @@
 #ifndef PUSH_SERVER_ASYNC_HPP
 #define PUSH_SERVER_ASYNC_HPP
 
-#include <set>
+#include <list>
+#include <unordered_map>
 #include <deque>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <chrono>
+#include <optional>
+#include <runtime.hpp>
 #include <net.hpp>
+#include <outbox.hpp>
+#include <heartbeat.hpp>
+#include <segment_log.hpp>
+#include <authenticator.hpp>
+#include <login.pb.h>
  
 class user
 {
     public:
         virtual ~user() {}
-        virtual void transfer(const buffer_t& buffer) = 0;
+        // called on the io_context thread that owns the user's shard
+        virtual void transfer(const shared_buffer& buffer) = 0;
 };
 
 using user_t = std::shared_ptr<user>;
 
-class groups
+using topic_t = uint16_t;
+using batch_t = std::vector<std::pair<topic_t, shared_buffer>>;
+
+// the latest messages of one topic in seq order, so a subscriber that comes back
+// with the last seq it saw can catch up from memory instead of a full resync
+class replay_ring
 {
     public:
-        void join(user_t user)
+        explicit replay_ring(size_t capacity) : capacity_(capacity)
+        {
+        }
+
+        void push(uint32_t seq, const shared_buffer& buffer)
         {
-            groups_.insert(user);
+            if (ring_.size() < capacity_)
+                ring_.emplace_back(seq, buffer);
+            else
+                ring_[next_] = { seq, buffer };
+            next_ = (next_ + 1) % capacity_;
         }
 
-        void leave(user_t user)
+        // true if nothing after seq has been pushed out of the ring yet
+        bool covers(uint32_t seq) const
         {
-            groups_.erase(user);
+            if (ring_.empty())
+                return false;
+            size_t oldest = ring_.size() < capacity_ ? 0 : next_;
+            return static_cast<int32_t>(ring_[oldest].first - seq) <= 1;
         }
 
-        void transfer(const buffer_t& buffer)
+        // every kept message after seq, oldest first; seq wraps, so compare by distance
+        template <typename F>
+        void since(uint32_t seq, F&& f) const
         {
-            for (auto& user: groups_)
-                 user->transfer(buffer);
+            size_t begin = ring_.size() < capacity_ ? 0 : next_;
+            for (size_t i = 0; i < ring_.size(); ++i)
+            {
+                auto& [id, buffer] = ring_[(begin + i) % ring_.size()];
+                if (static_cast<int32_t>(id - seq) > 0)
+                    f(buffer);
+            }
         }
 
     private:
-        std::set<user_t> groups_;
+        size_t capacity_;
+        size_t next_ = 0;
+        std::vector<std::pair<uint32_t, shared_buffer>> ring_;
 };
 
-class session : public user, public std::enable_shared_from_this<session>
+// the seq and the replay ring of every topic, shared by all shards so a subscriber
+// resumes from memory whichever shard it lands on. a topic has a ring while it
+// has subscribers anywhere; once the last one leaves, the ring lingers for a while
+// so a reconnect can still resume from it. what neither the ring nor the log can
+// replay any more is reported as a gap.
+class history
 {
     public:
-        session(net::io_context& ioc, socket_t socket, groups& groups) :
-        ioc_(ioc), socket_(std::move(socket)), groups_(groups)
+        using time_point_t = std::chrono::steady_clock::time_point;
+
+        // how long, and for how many topics, rings outlive their subscribers
+        static constexpr std::chrono::seconds linger{60};
+        static constexpr size_t max_lingering = 256;
+
+        // last is the seq the topic is at and live messages are skipped up to, gap is
+        // set when some of what came after the subscriber's seq is gone and it has
+        // to resync from last
+        struct resume
+        {
+            uint32_t last;
+            bool gap;
+        };
+
+        history(size_t replay_size, segment_log* log) :
+        replay_size_(replay_size), log_(log)
         {
         }
 
-        std::shared_ptr<session> shared_this()
+        // stamps each message with the next seq of its topic, continuing from the log
+        // after a restart; seqs are assigned, kept, logged and handed to post under
+        // one lock so every shard sees a topic in the same order
+        template <typename F>
+        void publish(batch_t batch, F&& post)
         {
-            return shared_from_this();
+            std::lock_guard<std::mutex> lock(mutex_);
+            sweep();
+            for (auto& [id, buffer]: batch)
+            {
+                auto& entry = find(id);
+                protocol::patch_seq(buffer.data(), ++entry.seq);
+                if (entry.ring)
+                    entry.ring->push(entry.seq, buffer);
+            }
+            if (log_)
+                log_->append(batch);
+
+            post(std::make_shared<const batch_t>(std::move(batch)));
         }
 
-        void run()
+        // a shard got its first subscriber of the topic
+        void join(topic_t id)
         {
-            groups_.join(shared_this());
-            do_read_header();
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& entry = find(id);
+            if (entry.shards++ == 0)
+                entry.idle_since = {};
+            if (! entry.ring)
+                entry.ring.emplace(replay_size_);
+            sweep();
         }
-    
-        void do_read_header()
+
+        // a shard lost its last subscriber of the topic
+        void leave(topic_t id)
         {
-            buffer_.resize(header_size());
-            net::async_read(socket_, net::buffer(buffer_),
-            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& entry = find(id);
+            if (--entry.shards == 0)
             {
-                self->on_read_header(ec, bytes_transferred);
-            });
+                entry.idle_since = std::chrono::steady_clock::now();
+                lingering_.emplace_back(id, entry.idle_since);
+            }
+            sweep();
         }
 
-        void on_read_header(error_code_t ec, size_t bytes_transferred)
+        // recent messages come from the ring; older ones are streamed from the log,
+        // which may run ahead of the caller's shard. room bounds the log burst.
+        template <typename F>
+        resume replay(topic_t id, uint32_t seq, size_t room, F&& f)
         {
-            if (ec == net::error::eof)
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto& entry = find(id);
+            uint32_t last = entry.seq;
+            if (seq == last)
+                return { last, false };
+            // ahead of the topic: seqs started over after a restart without the log
+            if (static_cast<int32_t>(seq - last) > 0)
+                return { last, true };
+
+            bool covered = entry.ring && entry.ring->covers(seq);
+            if (covered || (entry.ring && ! log_))
             {
-                std::cout << "session closed" << std::endl;
-                groups_.leave(shared_this());
-                return;
+                entry.ring->since(seq, std::forward<F>(f));
+                return { last, ! covered };
             }
+            lock.unlock();
 
-            do_read_message();
+            if (! log_)
+                return { last, true };
+            auto [first, end] = log_->read(id, seq, room, std::forward<F>(f));
+            if (static_cast<int32_t>(end - last) > 0)
+                return { end, first != seq + 1 };
+            return { last, first != seq + 1 || end != last };
         }
 
-        void do_read_message()
+    private:
+        struct topic
         {
-            size_t size = carrier_.decode_header(buffer_);
-            net::async_read(socket_, net::buffer(std::addressof(buffer_[header_size()]), size),
-            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            uint32_t seq = 0;
+            size_t shards = 0;           // shards with subscribers of the topic
+            std::optional<replay_ring> ring;
+            time_point_t idle_since;     // when the last subscriber left, zero while it has some
+        };
+
+        topic& find(topic_t id)
+        {
+            auto [it, inserted] = topics_.try_emplace(id);
+            if (inserted && log_)
+                it->second.seq = log_->last_seq(id);
+            return it->second;
+        }
+
+        // drop rings that lingered too long, or the oldest ones past max_lingering;
+        // an entry is stale if its topic got subscribers again, or lost them again later
+        void sweep()
+        {
+            auto expired = std::chrono::steady_clock::now() - linger;
+            while (! lingering_.empty() && (lingering_.size() > max_lingering || lingering_.front().second < expired))
             {
-                self->on_read_message(ec, bytes_transferred);
-            });
+                auto [id, since] = lingering_.front();
+                lingering_.pop_front();
+                auto it = topics_.find(id);
+                if (it != topics_.end() && it->second.idle_since == since)
+                    it->second.ring.reset();
+            }
+        }
+
+        size_t replay_size_;
+        segment_log* log_;
+        std::mutex mutex_;
+        std::unordered_map<topic_t, topic> topics_;
+        std::deque<std::pair<topic_t, time_point_t>> lingering_;
+};
+
+// the subscribers accepted by one io_context, indexed by topic so a message only
+// visits the users of its own topic; only that io_context's thread touches the
+// index, so subscribe and unsubscribe need no lock. a topic's users sit in a slab
+// of slots, one pointer each, and a subscriber keeps the slot it was given.
+class shard
+{
+    public:
+        shard(net::io_context& ioc, history& history, const heartbeat_options& options) :
+        ioc_(ioc), history_(history), beat_(ioc, options)
+        {
+            beat_.run();
+        }
+
+        net::io_context& context()
+        {
+            return ioc_;
+        }
+
+        heartbeat& beat()
+        {
+            return beat_;
         }
-        
-        void on_read_message(error_code_t ec, size_t bytes_transferred)
+
+        // returns the user's slot, freed slots are reused first
+        uint32_t subscribe(topic_t topic, user_t user)
         {
-            if (ec == net::error::eof)
+            auto [it, inserted] = topics_.try_emplace(topic);
+            if (inserted)
+                history_.join(topic);
+
+            auto& entry = it->second;
+            if (entry.free.empty())
             {
-                groups_.leave(shared_this());
+                entry.users.push_back(std::move(user));
+                return entry.users.size() - 1;
+            }
+
+            uint32_t slot = entry.free.back();
+            entry.free.pop_back();
+            entry.users[slot] = std::move(user);
+            return slot;
+        }
+
+        void unsubscribe(topic_t topic, uint32_t slot)
+        {
+            auto it = topics_.find(topic);
+            if (it == topics_.end())
                 return;
+
+            auto& entry = it->second;
+            entry.users[slot].reset();
+            entry.free.push_back(slot);
+            if (entry.free.size() == entry.users.size())
+            {
+                topics_.erase(it);
+                history_.leave(topic);
             }
+        }
+
+        template <typename F>
+        history::resume replay(topic_t topic, uint32_t seq, size_t room, F&& f)
+        {
+            return history_.replay(topic, seq, room, std::forward<F>(f));
+        }
 
-            carrier_.decode_message(buffer_);
-            auto login = carrier_.message();
-            std::cout << "message "  << login->message()  << std::endl;
+        // one post per shard per batch, the loop over each topic's users runs on the shard's thread
+        void transfer(std::shared_ptr<const batch_t> batch)
+        {
+            net::post(ioc_,
+            [this, batch = std::move(batch)]
+            {
+                for (auto& [topic, buffer]: *batch)
+                {
+                    auto it = topics_.find(topic);
+                    if (it == topics_.end())
+                        continue;
 
-            do_write();
+                    for (auto& user: it->second.users)
+                        if (user)
+                            user->transfer(buffer);
+                }
+            });
         }
 
-        void do_write()
+    private:
+        struct topic
         {
-            net::async_write(socket_, net::buffer(buffer_),
-            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            std::vector<user_t> users;
+            std::vector<uint32_t> free;
+        };
+
+        net::io_context& ioc_;
+        history& history_;
+        heartbeat beat_;
+        std::unordered_map<topic_t, topic> topics_;
+};
+
+class groups
+{
+    public:
+        explicit groups(size_t replay_size = 1024, segment_log* log = nullptr, const heartbeat_options& options = {}) :
+        history_(replay_size, log), options_(options)
+        {
+        }
+
+        // shards are added before the io_contexts start running and never removed
+        shard& add(net::io_context& ioc)
+        {
+            return shards_.emplace_back(ioc, history_, options_);
+        }
+
+        void transfer(batch_t batch)
+        {
+            history_.publish(std::move(batch),
+            [this](std::shared_ptr<const batch_t> shared)
             {
-                self->on_write(ec, bytes_transferred);
+                for (auto& shard: shards_)
+                    shard.transfer(shared);
             });
         }
-    
-        void on_write(error_code_t ec, size_t bytes_transferred)
+
+    private:
+        history history_;
+        heartbeat_options options_;
+        std::list<shard> shards_;
+};
+
+class session : public user, public keepalive, public std::enable_shared_from_this<session>
+{
+    public:
+        // subscribers only send logins and subscribe requests, the decoder grows
+        // for anything bigger up to max_frame
+        static constexpr size_t read_size = 512;
+        static constexpr size_t max_frame = 4096;
+
+        session(socket_t socket, shard& shard, const outbox_limits& limits, authenticator& auth) :
+        socket_(std::move(socket)), shard_(shard), auth_(auth), decoder_(read_size, max_frame), buffers_(limits)
         {
+        }
+
+        ~session()
+        {
+            shard_.beat().forget(*this);
+        }
+
+        std::shared_ptr<session> shared_this()
+        {
+            return shared_from_this();
+        }
+
+        void run()
+        {
+            error_code_t ec;
+            socket_.non_blocking(true, ec);
             if (ec)
+                return fail(ec, "non_blocking");
+            shard_.beat().watch(*this);
+            do_read();
+        }
+
+        // subscribers are idle almost all the time, so the session only waits for
+        // the socket to become readable and takes a read buffer from the pool once
+        // there is something to read, handing it back when no partial frame is left.
+        // a frame announced longer than max_frame is never waited for
+        void do_read()
+        {
+            if (decoder_.pending() > max_frame)
             {
-                groups_.leave(shared_this());
-                return fail(ec, "write");
+                fail(std::make_error_code(std::errc::message_size), "read");
+                do_close();
+                return leave();
             }
 
-            do_read_header();
+            socket_.async_wait(net::socket_base::wait_read,
+            [self = shared_this()](error_code_t ec)
+            {
+                self->on_wait(ec);
+            });
         }
 
-        void transfer(const buffer_t& buffer)
+        void on_wait(error_code_t ec)
         {
-            net::post(ioc_,
-            [this, buffer]
+            if (! ec)
+            {
+                auto [data, size] = decoder_.prepare();
+                size_t bytes_transferred = socket_.read_some(net::buffer(data, size), ec);
+                if (ec == std::errc::operation_would_block)
+                {
+                    decoder_.release();
+                    return do_read();
+                }
+                if (! ec)
+                    return on_read(bytes_transferred);
+            }
+
+            std::cout << "session closed" << std::endl;
+            leave();
+        }
+
+        void on_read(size_t bytes_transferred)
+        {
+            shard_.beat().touch(*this);
+            decoder_.commit(bytes_transferred);
+            process();
+        }
+
+        // the first frame must be a login; anything behind it waits in the decoder,
+        // with no read pending, until the login has been verified
+        void process()
+        {
+            while (auto view = decoder_.next())
+            {
+                auto mode = static_cast<mode_type>(view->header.mode());
+                if (mode == mode_type::ping)
+                    send(mode_type::pong);
+                else if (mode == mode_type::pong)
+                    continue;
+                else if (! authenticated_)
+                    return do_login(view.value());
+                else
+                    subscribe(view->header);
+            }
+            decoder_.consume();
+            decoder_.release();
+            do_read();
+        }
+
+        void do_login(const decoder::view& view)
+        {
+            header_ = view.header;
+            auto& carrier = login_carrier();
+            if (! carrier.decode_message(view.data + header_size(), view.size - header_size()))
+                return on_login(error_type::unauthorized);
+
+            auto login = carrier.message();
+            std::cout << "login " << login->username() << " topic " << header_.service() << std::endl;
+            error_code_t ec;
+            auto source = socket_.remote_endpoint(ec).address().to_string();
+            auth_.verify(shard_.context(), source, login->username(), login->password(),
+            [self = shared_this()](error_type error)
+            {
+                self->on_login(error);
+            });
+        }
+
+        // the reply goes first on the push queue, a catch-up burst follows it. a busy
+        // server also closes, the client tries again later
+        void on_login(error_type error)
+        {
+            protocol header = header_;
+            header.set_mode(static_cast<uint8_t>(mode_type::response));
+            header.set_error(static_cast<uint16_t>(error));
+            auto& carrier = login_carrier();
+            carrier.set_header(header);
+            carrier.message()->Clear();
+            if (error == error_type::none)
+                carrier.message()->set_message("welcome");
+            else if (error == error_type::busy)
+                carrier.message()->set_message("busy");
+            else
+                carrier.message()->set_message("unauthorized");
+
+            shared_buffer reply;
+            carrier.pack(reply);
+            if (buffers_.push(std::move(reply)))
+                write_buffer();
+
+            if (error != error_type::none)
+            {
+                closing_ = true;
+                return;
+            }
+
+            authenticated_ = true;
+            subscribe(header_);
+            process();
+        }
+
+        // subscribe joins the topic in the service field, a nonzero seq asks for
+        // what the topic published after it
+        void subscribe(const protocol& header)
+        {
+            topic_t topic = header.service();
+            auto it = std::find_if(topics_.begin(), topics_.end(), [topic](auto& entry){ return entry.first == topic; });
+            if (static_cast<mode_type>(header.mode()) == mode_type::unsubscribe)
+            {
+                if (it != topics_.end())
+                {
+                    shard_.unsubscribe(topic, it->second);
+                    topics_.erase(it);
+                }
+                return;
+            }
+
+            if (it != topics_.end())
+                return;
+
+            topics_.emplace_back(topic, shard_.subscribe(topic, shared_this()));
+            if (header.seq() == 0)
+                return;
+
+            bool idle = false;
+            auto [last, gap] = shard_.replay(topic, header.seq(), buffers_.room(),
+            [this, &idle](const shared_buffer& buffer)
             {
-                bool write_in_progress = ! buffers_.empty();
-                buffers_.push_back(buffer);
-                if (! write_in_progress)
-                    write_buffer();
+                idle = buffers_.push(buffer);
             });
+            if (last)
+                replayed_[topic] = last;
+            if (idle)
+                write_buffer();
+            if (gap)
+                resync(header, last);
+        }
+
+        // some of what the topic published after the subscriber's seq is gone; the
+        // reply follows whatever could still be replayed and carries the seq the
+        // topic is at, the client resyncs its state from there
+        void resync(const protocol& request, uint32_t seq)
+        {
+            protocol header = request;
+            header.set_mode(static_cast<uint8_t>(mode_type::response));
+            header.set_seq(seq);
+            header.set_error(static_cast<uint16_t>(error_type::gap));
+            auto& carrier = login_carrier();
+            carrier.set_header(header);
+            carrier.message()->Clear();
+            carrier.message()->set_message("gap");
+
+            shared_buffer reply;
+            carrier.pack(reply);
+            if (buffers_.push(std::move(reply)))
+                write_buffer();
+        }
+
+        void transfer(const shared_buffer& buffer)
+        {
+            if (! replayed_.empty() && replayed(buffer))
+                return;
+
+            if (buffers_.push(buffer))
+                write_buffer();
+            else if (buffers_.overflow())
+                do_close();
+        }
+
+        void ping()
+        {
+            send(mode_type::ping);
+        }
+
+        void expire()
+        {
+            std::cout << "session expired" << std::endl;
+            do_close();
+        }
+
+        std::shared_ptr<keepalive> ref()
+        {
+            return weak_from_this().lock();
+        }
+
+        void send(mode_type mode)
+        {
+            auto header = control_header(mode);
+            shared_buffer buffer(header.size());
+            std::copy(header.begin(), header.end(), buffer.data());
+            if (buffers_.push(std::move(buffer)))
+                write_buffer();
         }
 
         void write_buffer()
         {
-            net::async_write(socket_, net::buffer(buffers_.front()),
+            net::async_write(socket_, buffers_.flush(),
             [self = shared_this(), this](error_code_t ec, size_t bytes_transferred)
             {
                 if (! ec)
                 {
-                    buffers_.pop_front();
-                    if (! buffers_.empty())
+                    if (buffers_.written())
                         write_buffer();
+                    else if (closing_)
+                        do_close();
                 }
                 else
-                    groups_.leave(shared_this());
+                    leave();
+            });
+        }
+
+        // the shard may be iterating its topics, so only close here and let the
+        // failing read leave them
+        void do_close()
+        {
+            error_code_t ec;
+            socket_.shutdown(net::socket_base::shutdown_both, ec);
+            socket_.close(ec);
+        }
+
+        // one per thread: a session only needs it while its login is handled
+        static carrier<pb::login>& login_carrier()
+        {
+            static thread_local carrier<pb::login> carrier;
+            return carrier;
+        }
+
+        // live messages the log replay already sent; once past them the topic is caught up
+        bool replayed(const shared_buffer& buffer)
+        {
+            protocol header;
+            header.decode(buffer.data());
+            auto it = replayed_.find(header.service());
+            if (it == replayed_.end())
+                return false;
+            if (static_cast<int32_t>(header.seq() - it->second) <= 0)
+                return true;
+            replayed_.erase(it);
+            return false;
+        }
+
+        void leave()
+        {
+            for (auto [topic, slot] : topics_)
+                shard_.unsubscribe(topic, slot);
+            topics_ = {};
+        }
+
+    private:
+        socket_t socket_;
+        shard& shard_;
+        authenticator& auth_;
+        bool authenticated_ = false;
+        bool closing_ = false;
+        protocol header_;
+        std::vector<std::pair<topic_t, uint32_t>> topics_;
+        std::unordered_map<topic_t, uint32_t> replayed_;
+        decoder decoder_;
+        outbox<shared_buffer> buffers_;
+};
+
+// backend connection on the ingestion port: every frame it sends is a message for
+// the topic in its service field and is forwarded to subscribers as a notify.
+// all frames decoded in one wakeup go to the shards as one batch.
+class publisher : public std::enable_shared_from_this<publisher>
+{
+    public:
+        // largest frame a publisher may send
+        static constexpr size_t max_frame = 1024 * 1024;
+
+        publisher(socket_t socket, groups& groups) :
+        socket_(std::move(socket)), groups_(groups), decoder_(16 * 1024, max_frame)
+        {
+        }
+
+        std::shared_ptr<publisher> shared_this()
+        {
+            return shared_from_this();
+        }
+
+        void run()
+        {
+            do_read();
+        }
+
+        void do_read()
+        {
+            auto [data, size] = decoder_.prepare();
+            if (! data)
+                return on_read(std::make_error_code(std::errc::message_size), 0);
+
+            socket_.async_read_some(net::buffer(data, size),
+            [self = shared_this()](error_code_t ec, size_t bytes_transferred)
+            {
+                self->on_read(ec, bytes_transferred);
             });
         }
 
+        void on_read(error_code_t ec, size_t bytes_transferred)
+        {
+            if (ec)
+            {
+                if (ec == std::errc::message_size)
+                    fail(ec, "publisher");
+                std::cout << "publisher closed" << std::endl;
+                return;
+            }
+
+            batch_t batch;
+            bool valid = true;
+            decoder_.commit(bytes_transferred);
+            while (auto view = decoder_.next())
+            {
+                if (! (valid = publishable(view->header)))
+                    break;
+
+                shared_buffer buffer(view->size);
+                std::copy_n(view->data, view->size, buffer.data());
+                protocol::patch_mode(buffer.data(), mode_type::notify);
+                protocol::patch_error(buffer.data(), static_cast<uint16_t>(error_type::none));
+                batch.emplace_back(view->header.service(), std::move(buffer));
+            }
+            decoder_.consume();
+
+            if (! batch.empty())
+                groups_.transfer(std::move(batch));
+
+            if (! valid)
+                return fail(std::make_error_code(std::errc::protocol_error), "publisher");
+            do_read();
+        }
+
+    private:
+        // subscriptions and heartbeats are between a subscriber and the server
+        static bool publishable(const protocol& header)
+        {
+            auto mode = static_cast<mode_type>(header.mode());
+            return mode == mode_type::request || mode == mode_type::response || mode == mode_type::notify;
+        }
+
     private:
-        net::io_context& ioc_;
         socket_t socket_;
         groups& groups_;
-        buffer_t buffer_;
-        carrier_t carrier_;
-        std::deque<buffer_t> buffers_;
+        decoder decoder_;
 };
 
 class listener : public std::enable_shared_from_this<listener>
 {
     public:
-        listener(net::io_context& ioc, endpoint_t endpoint) : ioc_(ioc), acceptor_(ioc)
+        using accept_t = std::function<void (socket_t)>;
+
+        listener(net::io_context& ioc, endpoint_t endpoint, accept_t accept, bool reuseport = false) :
+        acceptor_(ioc), accept_(std::move(accept))
         {
             error_code_t ec;
             acceptor_.open(endpoint.protocol(), ec);
@@ -181,6 +766,14 @@ class listener : public std::enable_shared_from_this<listener>
                 return;
             }
 
+            if (reuseport)
+                acceptor_.set_option(reuse_port(true), ec);
+            if (ec)
+            {
+                fail(ec, "set_option");
+                return;
+            }
+
             acceptor_.bind(endpoint, ec);
             if (ec)
             {
@@ -217,19 +810,13 @@ class listener : public std::enable_shared_from_this<listener>
             if (ec)
                 fail(ec, "accept");
             else
-                std::make_shared<session>(ioc_, std::move(socket), groups_)->run();
+                accept_(std::move(socket));
             do_accept();
         }
 
-       groups& get()
-       {
-           return groups_;
-       }
-
     private:
-        net::io_context& ioc_;
         tcp::acceptor acceptor_;
-        groups groups_;
+        accept_t accept_;
 };
 
 #endif
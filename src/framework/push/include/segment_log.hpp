@@ -0,0 +1,589 @@
+#ifndef SEGMENT_LOG_HPP
+#define SEGMENT_LOG_HPP
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <filesystem>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <condition_variable>
+#include <net.hpp>
+
+struct log_options
+{
+    std::string dir;
+    size_t segment_bytes = 64 * 1024 * 1024;
+    // the retention budget is shared by all topics
+    size_t retain_bytes = 1024 * 1024 * 1024;
+    size_t retain_segments = 4096;
+    std::chrono::seconds retain_age = std::chrono::hours(24);
+    std::chrono::milliseconds sync_interval = std::chrono::milliseconds(1000);
+};
+
+inline std::error_code last_error()
+{
+    return std::error_code(errno, std::system_category());
+}
+
+// one file of a topic's log named <topic>-<first seq>.log: packed frames are
+// appended with pwritev and read back through a read-only shared mapping, so
+// replay hands mapped pages straight to the socket. only the segment being
+// written keeps its file open and its mapping; a sealed one is mapped again
+// when it is read and unmapped once the last view of it is gone.
+class segment
+{
+    public:
+        using mapping_t = std::shared_ptr<byte_t[]>;
+
+        // create preallocates a segment to write, otherwise an existing one from a
+        // previous run is indexed and sealed
+        segment(const std::string& path, uint32_t first, size_t capacity, bool create) :
+        path_(path), first_(first), capacity_(capacity), sealed_(! create)
+        {
+            fd_ = ::open(path.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+            if (fd_ < 0)
+            {
+                fail(last_error(), "open");
+                return;
+            }
+
+            struct stat st;
+            if (create ? ::ftruncate(fd_, capacity_) : ::fstat(fd_, &st))
+            {
+                fail(last_error(), "segment");
+                if (create)
+                    remove();
+                return;
+            }
+
+            if (! create)
+            {
+                capacity_ = st.st_size;
+                last_write_ = std::chrono::system_clock::from_time_t(st.st_mtime);
+            }
+
+            auto data = map(fd_, capacity_);
+            if (! data)
+            {
+                if (create)
+                    remove();
+                return;
+            }
+
+            if (create)
+                pin_ = data;
+            else
+            {
+                scan(data.get());
+                close();
+            }
+            open_ = true;
+        }
+
+        ~segment()
+        {
+            close();
+        }
+
+        bool is_open() const
+        {
+            return open_;
+        }
+
+        // appends whole frames while they fit and returns the first one that did not
+        template <typename Iterator>
+        Iterator append(Iterator begin, Iterator end)
+        {
+            if (sealed_)
+                return begin;
+
+            iovec iov[64];
+            size_t count = 0;
+            size_t bytes = 0;
+            auto it = begin;
+            for (; it != end && count < std::size(iov); ++it)
+            {
+                auto& buffer = it->second;
+                if (end_ + bytes + buffer.size() > capacity_)
+                    break;
+                iov[count++] = { const_cast<byte_t*>(buffer.data()), buffer.size() };
+                bytes += buffer.size();
+            }
+
+            if (count == 0)
+                return it;
+
+            if (::pwritev(fd_, iov, count, end_) != static_cast<ssize_t>(bytes))
+            {
+                fail(last_error(), "pwritev");
+                seal();
+                return begin;
+            }
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                offsets_.push_back(end_);
+                end_ += iov[i].iov_len;
+            }
+            last_write_ = std::chrono::system_clock::now();
+            dirty_ = true;
+            return it;
+        }
+
+        // no more appends; the mapping is kept only while something reads it
+        void seal()
+        {
+            sealed_ = true;
+            pin_.reset();
+        }
+
+        bool sealed() const
+        {
+            return sealed_;
+        }
+
+        void sync()
+        {
+            if (fd_ >= 0 && ::fdatasync(fd_))
+                fail(last_error(), "fdatasync");
+        }
+
+        // only once a sealed segment's last write is synced
+        void close()
+        {
+            if (fd_ >= 0)
+                ::close(fd_);
+            fd_ = -1;
+        }
+
+        // the mapping stays valid for whoever still holds a view of it
+        void remove()
+        {
+            if (::unlink(path_.c_str()))
+                fail(last_error(), "unlink");
+        }
+
+        // the mapping to read from, a sealed segment nobody reads is mapped again
+        mapping_t data()
+        {
+            if (auto data = mapping_.lock())
+                return data;
+            if (end_ == 0)
+                return {};
+
+            int fd = ::open(path_.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                fail(last_error(), "open");
+                return {};
+            }
+            auto data = map(fd, end_);
+            ::close(fd);
+            return data;
+        }
+
+        uint32_t first() const
+        {
+            return first_;
+        }
+
+        uint32_t last() const
+        {
+            return first_ + offsets_.size() - 1;
+        }
+
+        size_t count() const
+        {
+            return offsets_.size();
+        }
+
+        size_t offset(uint32_t seq) const
+        {
+            return offsets_[seq - first_];
+        }
+
+        const std::vector<size_t>& offsets() const
+        {
+            return offsets_;
+        }
+
+        size_t end() const
+        {
+            return end_;
+        }
+
+        bool dirty()
+        {
+            return std::exchange(dirty_, false);
+        }
+
+        std::chrono::system_clock::time_point last_write() const
+        {
+            return last_write_;
+        }
+
+    private:
+        mapping_t map(int fd, size_t size)
+        {
+            void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                fail(last_error(), "mmap");
+                return {};
+            }
+
+            mapping_t mapping(static_cast<byte_t*>(data),
+            [size](byte_t* data)
+            {
+                ::munmap(data, size);
+            });
+            mapping_ = mapping;
+            return mapping;
+        }
+
+        // rebuild the index of a segment from a previous run: frames follow each
+        // other with consecutive seqs, the zeroed tail or a torn frame ends it
+        void scan(const byte_t* data)
+        {
+            while (end_ + header_size() <= capacity_)
+            {
+                protocol header;
+                header.decode(data + end_);
+                size_t size = header_size() + header.length();
+                if (header.seq() != first_ + offsets_.size() || end_ + size > capacity_)
+                    break;
+                offsets_.push_back(end_);
+                end_ += size;
+            }
+        }
+
+        std::string path_;
+        uint32_t first_;
+        size_t capacity_;
+        int fd_ = -1;
+        bool open_ = false;
+        bool sealed_;
+        mapping_t pin_;
+        std::weak_ptr<byte_t[]> mapping_;
+        size_t end_ = 0;
+        bool dirty_ = false;
+        std::vector<size_t> offsets_;
+        std::chrono::system_clock::time_point last_write_ = std::chrono::system_clock::now();
+};
+
+// append-only per-topic log of published messages so replay survives a restart.
+// writes go to the page cache under the log's lock, a background thread batches
+// fdatasync calls, seals the segments of idle topics and keeps all topics within
+// one retention budget. messages that cannot be written are counted and logged,
+// and the log waits a moment before it rolls a new segment to try again.
+class segment_log
+{
+    public:
+        using segment_t = std::shared_ptr<segment>;
+
+        // how long a topic's segment stays open without writes, and how long the
+        // log stops writing after a failure
+        static constexpr std::chrono::seconds idle{60};
+        static constexpr std::chrono::seconds retry{1};
+
+        explicit segment_log(const log_options& options) : options_(options)
+        {
+            std::error_code ec;
+            std::filesystem::create_directories(options_.dir, ec);
+            if (ec)
+            {
+                fail(ec, "log");
+                return;
+            }
+
+            std::map<uint16_t, std::map<uint32_t, std::string>> found;
+            for (auto& entry : std::filesystem::directory_iterator(options_.dir, ec))
+            {
+                unsigned topic, first;
+                if (std::sscanf(entry.path().filename().c_str(), "%u-%u.log", &topic, &first) == 2)
+                    found[topic][first] = entry.path();
+            }
+            if (ec)
+            {
+                fail(ec, "log");
+                return;
+            }
+
+            for (auto& [topic, files] : found)
+                for (auto& [first, path] : files)
+                {
+                    auto seg = std::make_shared<segment>(path, first, 0, false);
+                    if (seg->is_open())
+                        topics_[topic].push_back(seg);
+                }
+
+            open_ = true;
+            flusher_ = std::thread([this]{ flush(); });
+        }
+
+        ~segment_log()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            cv_.notify_one();
+            if (flusher_.joinable())
+                flusher_.join();
+        }
+
+        bool is_open() const
+        {
+            return open_;
+        }
+
+        // seq of the newest logged message of a topic, 0 if there is none
+        uint32_t last_seq(uint16_t topic)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = topics_.find(topic);
+            if (it == topics_.end() || it->second.empty())
+                return 0;
+            auto& seg = it->second.back();
+            return seg->count() ? seg->last() : seg->first() - 1;
+        }
+
+        // batch is a sequence of (topic, packed frame with its seq stamped). what
+        // cannot be written is dropped and the topic's segment sealed, so the next
+        // one starts at the seq it holds and no segment skips a seq
+        template <typename Batch>
+        void append(const Batch& batch)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            bool waiting = std::chrono::steady_clock::now() < retry_at_;
+            size_t dropped = 0;
+            for (auto it = batch.begin(); it != batch.end();)
+            {
+                auto run = std::find_if(it, batch.end(), [&](auto& item){ return item.first != it->first; });
+                auto& segs = topics_[it->first];
+                while (! waiting && it != run)
+                {
+                    auto next = segs.empty() ? it : segs.back()->append(it, run);
+                    if (next == it)
+                    {
+                        if (! roll(segs, it->first, it->second))
+                            break;
+                        next = segs.back()->append(it, run);
+                        if (next == it)
+                        {
+                            // the first frame always fits a new segment, so its write failed
+                            segs.back()->remove();
+                            segs.pop_back();
+                            break;
+                        }
+                    }
+                    it = next;
+                }
+
+                if (it != run)
+                {
+                    dropped += std::distance(it, run);
+                    if (! segs.empty())
+                        segs.back()->seal();
+                    waiting = true;
+                }
+                it = run;
+            }
+            if (dropped)
+                failed(dropped);
+        }
+
+        // messages that could not be logged since the start
+        size_t dropped() const
+        {
+            return dropped_.load(std::memory_order_relaxed);
+        }
+
+        // streams the logged messages after seq as views of the mapped segments,
+        // in chunks of whole frames; when they do not all fit in room only the
+        // newest ones are sent, and after a hole left by a failed write only the
+        // ones that follow it. returns the seqs of the first and last message
+        // handed to f, zeros if there were none.
+        template <typename F>
+        std::pair<uint32_t, uint32_t> read(uint16_t topic, uint32_t seq, size_t room, F&& f)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = topics_.find(topic);
+            if (it == topics_.end())
+                return {};
+
+            auto& segs = it->second;
+            uint32_t from = seq + 1;
+            uint32_t after = 0;
+            size_t bytes = 0;
+            for (auto s = segs.rbegin(); s != segs.rend(); ++s)
+            {
+                auto& seg = *s;
+                if (seg->count() == 0)
+                    continue;
+                if (seg->last() < from)
+                    break;
+                if (after && seg->last() + 1 != after)
+                {
+                    from = after;
+                    break;
+                }
+                after = seg->first();
+
+                uint32_t lo = std::max(from, seg->first());
+                if (bytes + seg->end() - seg->offset(lo) > room)
+                {
+                    auto& offsets = seg->offsets();
+                    auto need = seg->end() - (room - bytes);
+                    from = seg->first() + (std::lower_bound(offsets.begin(), offsets.end(), need) - offsets.begin());
+                    break;
+                }
+                bytes += seg->end() - seg->offset(lo);
+            }
+
+            uint32_t first = 0;
+            uint32_t last = 0;
+            for (auto& seg : segs)
+            {
+                if (seg->count() == 0 || seg->last() < from)
+                    continue;
+
+                auto data = seg->data();
+                if (! data)
+                    break;
+
+                if (! first)
+                    first = std::max(from, seg->first());
+                auto& offsets = seg->offsets();
+                size_t begin = seg->offset(std::max(from, seg->first()));
+                for (size_t i = std::max(from, seg->first()) - seg->first(); i < offsets.size(); ++i)
+                    if (offsets[i] - begin >= chunk_bytes)
+                    {
+                        f(view(data, begin, offsets[i]));
+                        begin = offsets[i];
+                    }
+                f(view(data, begin, seg->end()));
+                last = seg->last();
+            }
+            return { first, last };
+        }
+
+    private:
+        static constexpr size_t chunk_bytes = 256 * 1024;
+
+        static shared_buffer view(const segment::mapping_t& data, size_t begin, size_t end)
+        {
+            return shared_buffer(segment::mapping_t(data, data.get() + begin), end - begin);
+        }
+
+        template <typename Buffer>
+        bool roll(std::deque<segment_t>& segs, uint16_t topic, const Buffer& next)
+        {
+            if (! segs.empty())
+                segs.back()->seal();
+
+            protocol header;
+            header.decode(next.data());
+            auto path = options_.dir + "/" + std::to_string(topic) + "-" + std::to_string(header.seq()) + ".log";
+            auto seg = std::make_shared<segment>(path, header.seq(), std::max(options_.segment_bytes, next.size()), true);
+            if (! seg->is_open())
+                return false;
+            segs.push_back(seg);
+            return true;
+        }
+
+        // one line per failure, the messages dropped while waiting to retry are only counted
+        void failed(size_t count)
+        {
+            auto total = dropped_.fetch_add(count, std::memory_order_relaxed) + count;
+            auto const now = std::chrono::steady_clock::now();
+            if (now < retry_at_)
+                return;
+
+            retry_at_ = now + retry;
+            std::cerr << "log: " << total << " messages not logged, retrying in " << retry.count() << "s\n";
+        }
+
+        // a sealed segment's file is closed once the sync after its last write is done
+        void flush()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (! stop_)
+            {
+                cv_.wait_for(lock, options_.sync_interval, [this]{ return stop_; });
+
+                auto const expired = std::chrono::system_clock::now() - idle;
+                std::vector<segment_t> dirty;
+                for (auto& [topic, segs] : topics_)
+                {
+                    if (! segs.empty() && segs.back()->last_write() < expired)
+                        segs.back()->seal();
+                    for (auto& seg : segs)
+                        if (seg->dirty())
+                            dirty.push_back(seg);
+                        else if (seg->sealed())
+                            seg->close();
+                }
+                retain();
+
+                lock.unlock();
+                for (auto& seg : dirty)
+                    seg->sync();
+                dirty.clear();
+                lock.lock();
+            }
+        }
+
+        // the oldest segments go first, whatever their topic, until the log is back
+        // within its age, byte and segment budget; a topic's newest segment stays
+        // so its seqs carry on after a restart
+        void retain()
+        {
+            auto const expired = std::chrono::system_clock::now() - options_.retain_age;
+            size_t bytes = 0;
+            size_t count = 0;
+            for (auto& [topic, segs] : topics_)
+                for (auto& seg : segs)
+                {
+                    bytes += seg->end();
+                    ++count;
+                }
+
+            while (true)
+            {
+                std::deque<segment_t>* oldest = nullptr;
+                for (auto& [topic, segs] : topics_)
+                    if (segs.size() > 1 && (! oldest || segs.front()->last_write() < oldest->front()->last_write()))
+                        oldest = &segs;
+                if (! oldest || (bytes <= options_.retain_bytes && count <= options_.retain_segments &&
+                                 oldest->front()->last_write() >= expired))
+                    break;
+
+                bytes -= oldest->front()->end();
+                --count;
+                oldest->front()->remove();
+                oldest->pop_front();
+            }
+        }
+
+        log_options options_;
+        bool open_ = false;
+        bool stop_ = false;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::unordered_map<uint16_t, std::deque<segment_t>> topics_;
+        std::chrono::steady_clock::time_point retry_at_;
+        std::atomic<size_t> dropped_{0};
+        std::thread flusher_;
+};
+
+#endif
@@ -0,0 +1,41 @@
+#include <push_bench_async.hpp>
+
+int main(int argc, char* argv[])
+{
+    if (argc != 5 && argc != 6)
+    {
+        std::cerr << "Usage:   " << argv[0] << " <host> <port> <connections> <seconds> [<topic>]\n"
+                  << "Example: " << argv[0] << " 127.0.0.1 8080 10000 10 1\n";
+        return 1;
+    }
+
+    auto const host = argv[1];
+    auto const port = argv[2];
+    auto const connections = static_cast<size_t>(std::stoul(argv[3]));
+    auto const seconds = std::stoul(argv[4]);
+    auto const topic = static_cast<uint16_t>(argc == 6 ? std::atoi(argv[5]) : 0);
+
+    net::io_context ioc{1};
+    tcp::resolver resolver{ioc};
+    auto const results = resolver.resolve(host, port);
+
+    stats stats;
+    for (size_t i = 0; i < connections; ++i)
+        std::make_shared<session>(ioc, stats, topic)->run(results);
+
+    std::thread t([&ioc]{ ioc.run(); });
+
+    size_t last = 0;
+    for (size_t i = 0; i < seconds; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        size_t messages = stats.messages.load();
+        std::cout << stats.connected.load() << " connected, " << messages - last << " msgs/sec\n";
+        last = messages;
+    }
+
+    ioc.stop();
+    t.join();
+
+    return 0;
+}
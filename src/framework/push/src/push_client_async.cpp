@@ -2,20 +2,21 @@
 
 int main(int argc, char** argv)
 {
-    if (argc != 3)
+    if (argc != 3 && argc != 4)
     {
-        std::cerr << "Usage:   " << argv[0] << " <host> <port>\n"
-                  << "Example: " << argv[0] << " 127.0.0.1 8080\n";
+        std::cerr << "Usage:   " << argv[0] << " <host> <port> [<topic>]\n"
+                  << "Example: " << argv[0] << " 127.0.0.1 8080 1\n";
         return 1;
     }
 
     auto const host = argv[1];
     auto const port = argv[2];
+    auto const topic = static_cast<uint16_t>(argc == 4 ? std::atoi(argv[3]) : 0);
 
     net::io_context ioc;
     std::string username = "root";
     std::string password = "****";
-    std::make_shared<session>(ioc, username, password)->run(host, port);
+    std::make_shared<session>(ioc, username, password, topic)->run(host, port);
     ioc.run();
 
     return 0;
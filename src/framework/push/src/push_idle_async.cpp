@@ -0,0 +1,58 @@
+#include <push_idle_async.hpp>
+
+int main(int argc, char* argv[])
+{
+    if (argc != 5 && argc != 6)
+    {
+        std::cerr << "Usage:   " << argv[0] << " <host> <port> <connections> <server pid> [<topic>]\n"
+                  << "Example: " << argv[0] << " 127.0.0.1 8080 100000 $(pidof push_server_async) 1\n";
+        return 1;
+    }
+
+    auto const host = argv[1];
+    auto const port = argv[2];
+    auto const connections = static_cast<size_t>(std::stoul(argv[3]));
+    auto const pid = std::atoi(argv[4]);
+    auto const topic = static_cast<uint16_t>(argc == 6 ? std::atoi(argv[5]) : 0);
+
+    net::io_context ioc{1};
+    tcp::resolver resolver{ioc};
+    auto const endpoint = resolver.resolve(host, port).begin()->endpoint();
+
+    auto const before = resident(pid);
+    if (before == 0)
+    {
+        std::cerr << "cannot read the rss of " << pid << "\n";
+        return 1;
+    }
+
+    stats stats;
+    std::thread t([&ioc]{ auto work = net::make_work_guard(ioc); ioc.run(); });
+
+    // connect in steps so the accept backlog keeps up
+    for (size_t i = 0; i < connections; i += 1000)
+    {
+        net::post(ioc, [&, i]
+        {
+            for (size_t j = i; j < std::min(i + 1000, connections); ++j)
+                std::make_shared<session>(ioc, stats, topic)->run(endpoint, j);
+        });
+        while (stats.connected + stats.failed < i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    while (stats.connected + stats.failed < connections)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // let the server settle before sampling
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    auto const after = resident(pid);
+    size_t const connected = stats.connected;
+    std::cout << connected << " idle connections, " << stats.failed.load() << " failed\n"
+              << "server rss " << before / 1024 << " KB -> " << after / 1024 << " KB, "
+              << (connected ? (after > before ? after - before : 0) / connected : 0) << " bytes per connection\n";
+
+    ioc.stop();
+    t.join();
+
+    return 0;
+}
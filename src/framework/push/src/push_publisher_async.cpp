@@ -0,0 +1,53 @@
+#include <push_publisher_async.hpp>
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3 && argc != 6)
+    {
+        std::cerr << "Usage:   " << argv[0] << " <host> <port> [<topic> <messages> <size>]\n"
+                  << "Example: " << argv[0] << " 127.0.0.1 8090\n"
+                  << "         " << argv[0] << " 127.0.0.1 8090 1 1000000 256\n";
+        return 1;
+    }
+
+    size_t const batch = 64 * 1024;
+
+    net::io_context ioc;
+    publisher pub(ioc);
+    if (! pub.connect(argv[1], argv[2]))
+        return 1;
+
+    // without a message count, publish stdin lines, flushing whenever the input runs dry
+    if (argc == 3)
+    {
+        std::string line;
+        while (std::getline(std::cin, line))
+        {
+            auto const topic = split_topic(line);
+            pub.publish(topic, prepend_timestamp(line));
+            if (pub.pending() >= batch || std::cin.rdbuf()->in_avail() == 0)
+                if (! pub.flush())
+                    return 1;
+        }
+        return pub.pending() && ! pub.flush();
+    }
+
+    auto const topic = static_cast<uint16_t>(std::atoi(argv[3]));
+    auto const messages = std::stoul(argv[4]);
+    std::string const message(std::stoul(argv[5]), 'x');
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < messages; ++i)
+    {
+        pub.publish(topic, message);
+        if (pub.pending() >= batch && ! pub.flush())
+            return 1;
+    }
+    if (pub.pending() && ! pub.flush())
+        return 1;
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << messages / elapsed.count() << " msgs/sec\n";
+
+    return 0;
+}
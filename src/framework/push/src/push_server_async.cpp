@@ -1,60 +1,105 @@
+#include <unistd.h>
 #include <push_server_async.hpp>
 
-std::string timestamp()
+int main(int argc, char* argv[])
 {
-    char date[80];
-    timespec tp;
-    clock_gettime(CLOCK_REALTIME, &tp);
-    tm* timeinfo = localtime(static_cast<time_t*>(&tp.tv_sec));
-    strftime(date, 80, "%Y-%m-%d-%H:%M:%S", timeinfo);
-    return std::string(date);
-}
-
+    auto mode = to_runtime_mode("reuseport");
+    auto policy = to_overflow_policy("drop_oldest");
+    size_t high = 4096;
+    auto users = "users.conf";
+    log_options options;
+    heartbeat_options beat;
 
-std::string prepend_timestamp(const std::string& message)
-{
-    std::string time("<");
-    time.append(timestamp());
-    time.append(1, '>');
-    time.append(1, ' ');
-    time.append(message);
-    return time;
-}
+    int opt;
+    bool usage = false;
+    while ((opt = getopt(argc, argv, "m:o:w:u:k:t:l:s:r:a:f:")) != -1)
+    {
+        if (opt == 'm')
+            mode = to_runtime_mode(optarg);
+        else if (opt == 'o')
+            policy = to_overflow_policy(optarg);
+        else if (opt == 'w')
+            high = std::stoul(optarg);
+        else if (opt == 'u')
+            users = optarg;
+        else if (opt == 'k')
+            beat.idle = std::chrono::seconds(std::stoul(optarg));
+        else if (opt == 't')
+            beat.timeout = std::chrono::seconds(std::stoul(optarg));
+        else if (opt == 'l')
+            options.dir = optarg;
+        else if (opt == 's')
+            options.segment_bytes = std::stoul(optarg) * 1024 * 1024;
+        else if (opt == 'r')
+            options.retain_bytes = std::stoul(optarg) * 1024 * 1024;
+        else if (opt == 'a')
+            options.retain_age = std::chrono::seconds(std::stoul(optarg));
+        else if (opt == 'f')
+            options.sync_interval = std::chrono::milliseconds(std::stoul(optarg));
+        else
+            usage = true;
+    }
 
-int main(int argc, char* argv[])
-{
-    if (argc != 3)
+    if (usage || argc - optind != 3)
     {
-        std::cerr << "Usage:   " << argv[0] << " <host> <port>\n"
-                  << "Example: " << argv[0] << " 0.0.0.0 8080\n";
+        std::cerr << "Usage:   " << argv[0] << " [-m <reuseport|pinned>] [-o <drop_oldest|coalesce|disconnect>] [-w <high watermark KB>] [-u <users.conf>]\n"
+                  << "         [-k <idle seconds before a ping, 0 off>] [-t <pong timeout seconds>]\n"
+                  << "         [-l <log dir> [-s <segment MB>] [-r <retain MB>] [-a <retain seconds>] [-f <fsync ms>]]\n"
+                  << "         <host> <port> <publish port>\n"
+                  << "Example: " << argv[0] << " -l /var/lib/push 0.0.0.0 8080 8090\n";
         return 1;
     }
 
-    auto const host = net::ip::make_address(argv[1]);
-    auto const port = static_cast<unsigned short>(std::atoi(argv[2]));
-
-    net::io_context ioc;
-    auto server = std::make_shared<listener>(ioc, endpoint_t{host, port});
-    server->run();
+    auto const host = net::ip::make_address(argv[optind]);
+    auto const port = static_cast<unsigned short>(std::atoi(argv[optind + 1]));
+    auto const publish = static_cast<unsigned short>(std::atoi(argv[optind + 2]));
+    auto const threads = static_cast<size_t>(std::thread::hardware_concurrency());
 
-    std::thread t([&ioc]{ ioc.run(); });
+    // a shard is owned by one io_context, so every thread needs its own
+    if (! mode || mode.value() == runtime_mode::shared)
+    {
+        std::cerr << "unsupported runtime mode\n";
+        return 1;
+    }
 
-    buffer_t buffer_;
-    carrier_t carrier_;
-    auto header = carrier_.header();
-    auto message = carrier_.message();
+    if (! policy)
+    {
+        std::cerr << "unknown overflow policy\n";
+        return 1;
+    }
 
-    std::string line;
-    auto& groups = server->get();
+    authenticator auth;
+    if (! auth.load(users))
+        return 1;
 
-    while (std::getline(std::cin, line))
+    std::unique_ptr<segment_log> log;
+    if (! options.dir.empty())
     {
-        message->set_message(prepend_timestamp(line));
-        carrier_.pack(buffer_);
-        groups.transfer(buffer_);
+        log = std::make_unique<segment_log>(options);
+        if (! log->is_open())
+            return 1;
     }
 
-    t.join();
+    auto const limits = watermarks(policy.value(), high * 1024, 4096);
+
+    groups groups(1024, log.get(), beat);
+    runtime<net::io_context> rt{mode.value(), threads};
+    rt.listen([&](net::io_context& ioc, bool reuseport)
+    {
+        auto& shard = groups.add(ioc);
+        std::make_shared<listener>(ioc, endpoint_t{host, port},
+        [&shard, &auth, limits](socket_t socket)
+        {
+            std::make_shared<session>(std::move(socket), shard, limits, auth)->run();
+        }, reuseport)->run();
+
+        std::make_shared<listener>(ioc, endpoint_t{host, publish},
+        [&groups](socket_t socket)
+        {
+            std::make_shared<publisher>(std::move(socket), groups)->run();
+        }, reuseport)->run();
+    });
+    rt.run();
 
     return 0;
 }
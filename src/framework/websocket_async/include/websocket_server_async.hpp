@@ -2,6 +2,7 @@
 #define WEBSOCKET_SERVER_ASYNC_HPP
 
 #include <websocket_async.hpp>
+#include <runtime.hpp>
  
 class session : public std::enable_shared_from_this<session>
 {
@@ -78,7 +79,7 @@ class session : public std::enable_shared_from_this<session>
 class listener : public std::enable_shared_from_this<listener>
 {
     public:
-        listener(net::io_context& ioc, endpoint_t endpoint) :
+        listener(net::io_context& ioc, endpoint_t endpoint, bool reuseport = false) :
         acceptor_(ioc), socket_(ioc)
         {
             error_code_t ec;
@@ -96,6 +97,14 @@ class listener : public std::enable_shared_from_this<listener>
                 return;
             }
 
+            if (reuseport)
+                acceptor_.set_option(reuse_port(true), ec);
+            if (ec)
+            {
+                fail(ec, "set_option");
+                return;
+            }
+
             acceptor_.bind(endpoint, ec);
             if (ec)
             {
@@ -2,26 +2,30 @@
 
 int main(int argc, char* argv[])
 {
-    if (argc != 3)
+    if (argc != 3 && argc != 4)
     {
-        std::cerr << "Usage:    " << argv[0] << " <host> <port>\n"
-                  << "Example:  " << argv[0] << " 0.0.0.0 80\n";
+        std::cerr << "Usage:    " << argv[0] << " <host> <port> [<shared|reuseport|pinned>]\n"
+                  << "Example:  " << argv[0] << " 0.0.0.0 80 reuseport\n";
         return 1;
     }
 
     auto const host = net::ip::make_address(argv[1]);
     auto const port = static_cast<unsigned short>(std::atoi(argv[2]));
-    auto const threads = static_cast<int>(std::thread::hardware_concurrency());
+    auto const threads = static_cast<size_t>(std::thread::hardware_concurrency());
+    auto const mode = to_runtime_mode(argc == 4 ? argv[3] : "shared");
 
-    net::io_context ioc{threads};
-    std::make_shared<listener>(ioc, endpoint_t{host, port})->run();
-
-    std::vector<std::thread> v;
-    v.reserve(threads - 1);
+    if (! mode)
+    {
+        std::cerr << "unknown runtime mode: " << argv[3] << "\n";
+        return 1;
+    }
 
-    for(auto i = threads - 1; i > 0; --i)
-        v.emplace_back([&ioc]{ ioc.run(); });
-    ioc.run();
+    runtime<net::io_context> rt{mode.value(), threads};
+    rt.listen([&](net::io_context& ioc, bool reuseport)
+    {
+        std::make_shared<listener>(ioc, endpoint_t{host, port}, reuseport)->run();
+    });
+    rt.run();
 
     return 0;
 }
@@ -2,6 +2,7 @@
 #define WEBSOCKET_SERVER_ASYNC_SSL_HPP
 
 #include <websocket_async_ssl.hpp>
+#include <runtime.hpp>
 #include <server_certificate.hpp>
 
 class session : public std::enable_shared_from_this<session>
@@ -91,7 +92,7 @@ class session : public std::enable_shared_from_this<session>
 class listener : public std::enable_shared_from_this<listener>
 {
     public:
-        listener(net::io_context& ioc, endpoint_t endpoint) :
+        listener(net::io_context& ioc, endpoint_t endpoint, bool reuseport = false) :
         acceptor_(ioc), socket_(ioc), ctx_server_(ssl::context::sslv23)
         {
             load_server_certificate(ctx_server_);
@@ -111,6 +112,14 @@ class listener : public std::enable_shared_from_this<listener>
                 return;
             }
 
+            if (reuseport)
+                acceptor_.set_option(reuse_port(true), ec);
+            if (ec)
+            {
+                fail(ec, "set_option");
+                return;
+            }
+
             acceptor_.bind(endpoint, ec);
             if (ec)
             {
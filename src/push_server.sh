@@ -1,3 +1,3 @@
 #!/bin/bash
 
-LD_LIBRARY_PATH=lib bin/push_server_async 0.0.0.0 8080
+LD_LIBRARY_PATH=lib bin/push_server_async -u bin/users.conf 0.0.0.0 8080 8090